@@ -29,14 +29,22 @@
 
 #include "qwebglcontext.h"
 
+#include "qwebglframearena.h"
 #include "qwebglfunctioncall.h"
+#include "qwebglgeometrycodec.h"
 #include "qwebglintegration.h"
 #include "qwebglintegration_p.h"
+#include "qwebgllatencytracer.h"
+#include "qwebglpixelconversion.h"
+#include "qwebgltexturecodec.h"
+#include "qwebgltrace.h"
 #include "qwebglwebsocketserver.h"
 #include "qwebglwindow.h"
 #include "qwebglwindow_p.h"
 
+#include <QtCore/qcache.h>
 #include <QtCore/qhash.h>
+#include <QtCore/qmutex.h>
 #include <QtCore/qpair.h>
 #include <QtCore/qrect.h>
 #include <QtCore/qset.h>
@@ -48,25 +56,65 @@
 #include <QtGui/qsurface.h>
 #include <QtWebSockets/qwebsocket.h>
 
+#include <chrono>
 #include <cstring>
 #include <limits>
+#include <memory>
+
+#ifndef GL_HALF_FLOAT_OES
+#define GL_HALF_FLOAT_OES 0x8D61
+#endif
 
 QT_BEGIN_NAMESPACE
 
 static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.context")
+static Q_LOGGING_CATEGORY(lcOptimistic, "qt.qpa.webgl.optimistic")
 
 class QWebGLContextPrivate
 {
 public:
     static QAtomicInt nextId;
-    static QSet<int> waitingIds;
+    using ResponseToken = QWebGLIntegrationPrivate::ResponseToken;
+    static const std::shared_ptr<ResponseToken> &responseToken();
+
+    static void expectResponse(const QWebGLFunctionCall *event,
+                               const QWebGLIntegrationPrivate::ClientData &clientData);
+
+    static bool optimisticQueries();
+    static QAtomicInt optimisticQueryMismatches;
+
     union { int id = -1; qintptr padded; };
     QPlatformSurface *currentSurface = nullptr;
     QSurfaceFormat surfaceFormat;
 };
 
 QAtomicInt QWebGLContextPrivate::nextId(1);
-QSet<int> QWebGLContextPrivate::waitingIds;
+QAtomicInt QWebGLContextPrivate::optimisticQueryMismatches(0);
+const std::shared_ptr<QWebGLContextPrivate::ResponseToken> &
+QWebGLContextPrivate::responseToken()
+{
+    // Shared with the pending entry, which can outlive the thread after a timeout
+    static thread_local const auto token = std::make_shared<ResponseToken>();
+    return token;
+}
+
+void QWebGLContextPrivate::expectResponse(const QWebGLFunctionCall *event,
+                                          const QWebGLIntegrationPrivate::ClientData &clientData)
+{
+    // Registered before the call is posted, so the response cannot arrive first
+    const auto &token = responseToken();
+    token->reset(event->id());
+    QWebGLIntegrationPrivate::instance()->expectResponse(event->id(), clientData, token);
+}
+
+bool QWebGLContextPrivate::optimisticQueries()
+{
+    static const bool enabled = []() {
+        const auto value = qgetenv("QT_WEBGL_OPTIMISTIC_QUERIES");
+        return !value.isEmpty() && value != "0";
+    }();
+    return enabled;
+}
 
 struct PixelStorageModes
 {
@@ -98,6 +146,8 @@ struct ContextData {
     PixelStorageModes pixelStorage;
     QMap<GLenum, QVariant> cachedParameters;
     QSet<QByteArray> stringCache;
+    QSet<GLuint> atlasTextures; // textures updated with glTexSubImage2D, never encoded lossy
+    QSet<GLuint> reducedPrecisionTextures; // see QWebGLContext::setTextureReducedPrecision
 };
 
 static QHash<int, ContextData> s_contextData;
@@ -173,22 +223,217 @@ inline int imageSize(GLsizei width, GLsizei height, GLenum format, GLenum type,
     return rowSize * height;
 }
 
-static void lockMutex()
+static const QWebGLIntegrationPrivate::ClientData *currentClientData()
+{
+    return QWebGLIntegrationPrivate::instance()->findClientData(currentContext()->currentSurface());
+}
+
+static bool clientSupportsImageBitmap()
+{
+    const auto clientData = currentClientData();
+    return clientData && clientData->supportsImageBitmap;
+}
+
+static bool clientSupportsDecompressionStream()
+{
+    const auto clientData = currentClientData();
+    return clientData && clientData->supportsDecompressionStream;
+}
+
+static QVariant texturePayload(GLenum format, GLenum type, GLsizei width, GLsizei height,
+                               const QByteArray &pixels, quint64 hash, bool allowLossy)
+{
+    if (QWebGLTextureCodec::policy() == QWebGLTextureCodec::Policy::None
+            || !clientSupportsImageBitmap()) {
+        return pixels;
+    }
+
+    // Applications tend to upload the same images again (glyph caches, reopened windows), keep
+    // the result of the last encodings, including the failed ones, by content hash. The hash is
+    // not collision free, a hit is only used if the source pixels are the same.
+    struct EncodedTexture
+    {
+        GLenum format;
+        GLenum type;
+        GLsizei width;
+        GLsizei height;
+        int unpackAlignment;
+        bool allowLossy;
+        bool encoded;
+        QWebGLTextureCodec::EncodedImage image;
+        QByteArray pixels; // shared with the outgoing message when the encoding failed
+    };
+    static QMutex mutex;
+    static QCache<quint64, EncodedTexture> cache(16 * 1024 * 1024);
+
+    const int unpackAlignment = currentContextData()->unpackAlignment;
+    {
+        QMutexLocker locker(&mutex);
+        const auto cached = cache.object(hash);
+        if (cached && cached->format == format && cached->type == type
+                && cached->width == width && cached->height == height
+                && cached->unpackAlignment == unpackAlignment
+                && cached->allowLossy == allowLossy && cached->pixels == pixels) {
+            if (cached->encoded)
+                return QVariant::fromValue(cached->image);
+            return pixels;
+        }
+    }
+
+    auto entry = new EncodedTexture { format, type, width, height, unpackAlignment, allowLossy,
+                                      false, {}, pixels };
+    entry->encoded = QWebGLTextureCodec::encode(format, type, width, height, unpackAlignment,
+                                                pixels.constData(), pixels.size(), allowLossy,
+                                                &entry->image);
+    const QVariant result = entry->encoded ? QVariant::fromValue(entry->image)
+                                           : QVariant(pixels);
+    QMutexLocker locker(&mutex);
+    cache.insert(hash, entry, qMax(1, entry->image.data.size() + pixels.size()));
+    return result;
+}
+
+// Produces the outgoing pixels of a texture upload, either converted or copied from 'pixels',
+// and hashes them and checks them for zeros in the same pass.
+static QByteArray uploadPixels(GLenum target, GLint *internalformat, GLenum *format,
+                               GLenum *type, GLsizei width, GLsizei height, const void *pixels,
+                               quint64 *hash, bool *isZero)
+{
+    const auto data = reinterpret_cast<const char *>(pixels);
+    QByteArray result;
+    if (convertPixels(target, internalformat, format, type, width, height, data, &result)) {
+        *hash = QWebGLPixelConversion::copyAndHash(result.constData(), nullptr, result.size(),
+                                                   isZero);
+    } else if (data) {
+        result.resize(imageSize(width, height, *format, *type,
+                                currentContextData()->pixelStorage));
+        *hash = QWebGLPixelConversion::copyAndHash(data, result.data(), result.size(), isZero);
+    } else {
+        *hash = 0;
+        *isZero = true;
+    }
+    return result;
+}
+
+// Rewrites format and type of a texture upload to something WebGL 1 consumes directly (BGRA) or
+// to a smaller representation (4444/565 for textures flagged with setTextureReducedPrecision,
+// half floats). The decision only depends on the texture, the format and the client, so full
+// and partial uploads of the same texture always agree. 'pixels' may be null, in which case
+// only the enums are updated. Returns true if 'converted' holds the new pixels.
+static bool convertPixels(GLenum target, GLint *internalformat, GLenum *format, GLenum *type,
+                          GLsizei width, GLsizei height, const char *pixels,
+                          QByteArray *converted)
+{
+    const auto contextData = currentContextData();
+    const auto clientData = currentClientData();
+    const int alignment = qMax(1, int(contextData->unpackAlignment));
+    const auto stride = [alignment, width](int bytesPerPixel) {
+        return (width * bytesPerPixel + alignment - 1) / alignment * alignment;
+    };
+    const bool reducedPrecision = target == GL_TEXTURE_2D
+            && contextData->reducedPrecisionTextures.contains(contextData->boundTexture2D);
+    bool changed = false;
+    QByteArray buffer;
+
+    const auto convertRows = [&](int sourceBytesPerPixel, int targetBytesPerPixel,
+                                 auto &&convertRow) {
+        const int sourceStride = stride(sourceBytesPerPixel);
+        const int targetStride = stride(targetBytesPerPixel);
+        buffer.resize(targetStride * height);
+        buffer.fill(0);
+        for (int y = 0; y < height; ++y)
+            convertRow(pixels + y * sourceStride, buffer.data() + y * targetStride);
+        converted->swap(buffer);
+        pixels = converted->constData();
+        changed = true;
+    };
+
+    if (*format == GL_BGRA_EXT && (*type == GL_UNSIGNED_BYTE || *type == GL_FLOAT)) {
+        if (pixels && *type == GL_UNSIGNED_BYTE) {
+            convertRows(4, 4, [width](const char *source, char *target) {
+                QWebGLPixelConversion::swizzleBgraToRgba(reinterpret_cast<const uchar *>(source),
+                                                         reinterpret_cast<uchar *>(target),
+                                                         width);
+            });
+        } else if (pixels) {
+            convertRows(16, 16, [width](const char *source, char *target) {
+                QWebGLPixelConversion::swizzleBgraToRgbaF(reinterpret_cast<const float *>(source),
+                                                          reinterpret_cast<float *>(target),
+                                                          width);
+            });
+        }
+        *format = GL_RGBA;
+        if (internalformat)
+            *internalformat = GL_RGBA;
+    }
+
+    if (*type == GL_FLOAT && (*format == GL_RGBA || *format == GL_RGB) && clientData
+            && clientData->supportsHalfFloatTextures
+            && (reducedPrecision || !clientData->supportsFloatTextures)) {
+        const int components = *format == GL_RGBA ? 4 : 3;
+        if (pixels) {
+            convertRows(components * 4, components * 2,
+                        [components, width](const char *source, char *target) {
+                QWebGLPixelConversion::floatToHalf(reinterpret_cast<const float *>(source),
+                                                   reinterpret_cast<quint16 *>(target),
+                                                   width * components);
+            });
+        }
+        *type = GL_HALF_FLOAT_OES;
+    } else if (reducedPrecision && *type == GL_UNSIGNED_BYTE && *format == GL_RGBA) {
+        if (pixels) {
+            convertRows(4, 2, [width](const char *source, char *target) {
+                QWebGLPixelConversion::packRgba4444(reinterpret_cast<const uchar *>(source),
+                                                    reinterpret_cast<quint16 *>(target), width);
+            });
+        }
+        *type = GL_UNSIGNED_SHORT_4_4_4_4;
+    } else if (reducedPrecision && *type == GL_UNSIGNED_BYTE && *format == GL_RGB) {
+        if (pixels) {
+            convertRows(3, 2, [width](const char *source, char *target) {
+                QWebGLPixelConversion::packRgb565(reinterpret_cast<const uchar *>(source),
+                                                  reinterpret_cast<quint16 *>(target), width);
+            });
+        }
+        *type = GL_UNSIGNED_SHORT_5_6_5;
+    }
+    return changed;
+}
+
+// The geometry payloads are added to the call directly, unencoded data is copied once from the
+// application memory into the call
+static void addVertexPayload(QWebGLFunctionCall *event, const char *data, int size,
+                             int elementSize)
 {
-    QWebGLIntegrationPrivate::instance()->webSocketServer->mutex()->lock();
+    QWebGLGeometryCodec::EncodedBuffer buffer;
+    if (QWebGLGeometryCodec::isEnabled() && clientSupportsDecompressionStream()
+            && QWebGLGeometryCodec::encodeVertices(data, size, elementSize, &buffer)) {
+        event->addVariant(QVariant::fromValue(buffer));
+    } else {
+        event->addData(data, size);
+    }
 }
 
-static void waitCondition(unsigned long time = ULONG_MAX)
+static void addIndexPayload(QWebGLFunctionCall *event, const char *data, int size,
+                            int indexSize)
 {
-    auto mutex = QWebGLIntegrationPrivate::instance()->webSocketServer->mutex();
-    auto waitCondition = QWebGLIntegrationPrivate::instance()->webSocketServer->waitCondition();
-    waitCondition->wait(mutex, time);
+    QWebGLGeometryCodec::EncodedBuffer buffer;
+    if (QWebGLGeometryCodec::isEnabled()
+            && QWebGLGeometryCodec::encodeIndices(data, size, indexSize, &buffer)) {
+        event->addVariant(QVariant::fromValue(buffer));
+    } else {
+        event->addData(data, size);
+    }
 }
 
-static void unlockMutex()
+static void addBufferPayload(QWebGLFunctionCall *event, GLenum target, const char *data,
+                             int size)
 {
-    auto mutex = QWebGLIntegrationPrivate::instance()->webSocketServer->mutex();
-    mutex->unlock();
+    // The index type is only known at draw time. Both codecs are lossless, so assuming 16 bit
+    // indices for element array buffers and 32 bit floats for everything else is always safe.
+    if (target == GL_ELEMENT_ARRAY_BUFFER)
+        addIndexPayload(event, data, size, 2);
+    else
+        addVertexPayload(event, data, size, 4);
 }
 
 static int elementSize(GLenum type)
@@ -235,7 +480,8 @@ static void setVertexAttribs(QWebGLFunctionCall *event, GLsizei count)
             int len = bufferSize(count, va.size, va.type, va.stride);
             event->addParameters(it.key(), va.size, int(va.type), va.normalized, va.stride);
             // found an enabled vertex attribute that was specified with a client-side pointer
-            event->addData(QByteArray(reinterpret_cast<const char *>(va.pointer), len));
+            addVertexPayload(event, reinterpret_cast<const char *>(va.pointer), len,
+                             elementSize(va.type));
         }
     }
 }
@@ -355,23 +601,31 @@ QHash<QString, const GLFunction *> GLFunction::byName;
 QStringList GLFunction::remoteFunctionNames;
 
 template<const GLFunction *Function>
-static QWebGLFunctionCall *createEventImpl(bool wait)
+static QWebGLFunctionCall *createEventImpl(bool wait,
+        QWebGLIntegrationPrivate::ResponseCallback callback = nullptr)
 {
     auto context = QOpenGLContext::currentContext();
     Q_ASSERT(context);
     const auto handle = static_cast<QWebGLContext *>(context->handle());
     auto integrationPrivate = QWebGLIntegrationPrivate::instance();
     const auto clientData = integrationPrivate->findClientData(handle->currentSurface());
-    if (!clientData || !clientData->socket
-            || clientData->socket->state() != QAbstractSocket::ConnectedState)
+    if (!clientData || !clientData->connectedSocket.loadAcquire())
         return nullptr;
-    return new QWebGLFunctionCall(Function->localName, handle->currentSurface(), wait);
+    const auto event = new QWebGLFunctionCall(Function->localName, handle->currentSurface(),
+                                              wait);
+    if (callback)
+        integrationPrivate->expectResponse(event->id(), *clientData, std::move(callback));
+    else if (wait)
+        QWebGLContextPrivate::expectResponse(event, *clientData);
+    return event;
 }
 
 static void postEventImpl(QWebGLFunctionCall *event)
 {
-    if (event->isBlocking())
-        QWebGLContextPrivate::waitingIds.insert(event->id());
+    // With I/O threads the WebSocket thread only routes the calls, see QWebGLWebSocketServer
+    if (QWebGLWebSocketServer::ioThreadCount())
+        event->setMessage(QWebGLWebSocketServer::encodeGlCommand(*event));
+    QWebGLTrace::Span span("postEvent");
     QCoreApplication::postEvent(QWebGLIntegrationPrivate::instance()->webSocketServer, event);
 }
 
@@ -426,6 +680,48 @@ static ReturnType postEventAndQuery(ReturnType defaultValue,
     return id != -1 ? queryValue(id, defaultValue) : defaultValue;
 }
 
+template<const GLFunction *Function, class ReturnType>
+static QWebGLIntegrationPrivate::ResponseCallback validateOptimistic(ReturnType expected)
+{
+    return [expected](const QVariant &value) {
+        if (value.isNull() || value.value<ReturnType>() == expected)
+            return;
+        QWebGLContextPrivate::optimisticQueryMismatches.ref();
+        qCWarning(lcOptimistic, "%s returned %s, assumed %s", qPrintable(Function->localName),
+                  qPrintable(value.toString()),
+                  qPrintable(QVariant::fromValue(expected).toString()));
+    };
+}
+
+// Status queries which nearly always succeed. With QT_WEBGL_OPTIMISTIC_QUERIES set they return
+// 'expected' immediately; the real answer is checked when it arrives and mismatches are logged
+// and counted instead of stalling the render thread for a round trip.
+template<const GLFunction *Function, class ReturnType, class...Ts>
+static ReturnType postEventAndQueryOptimistic(ReturnType expected, ReturnType defaultValue,
+                                              Ts&&... arguments)
+{
+    if (!QWebGLContextPrivate::optimisticQueries())
+        return postEventAndQuery<Function>(defaultValue, arguments...);
+    auto event = createEventImpl<Function>(true, validateOptimistic<Function>(expected));
+    if (!event)
+        return defaultValue;
+    addHelper(event, arguments...);
+    postEventImpl(event);
+    return expected;
+}
+
+template<const GLFunction *Function, class ReturnType>
+static ReturnType postEventAndQueryOptimistic(ReturnType expected, ReturnType defaultValue)
+{
+    if (!QWebGLContextPrivate::optimisticQueries())
+        return postEventAndQuery<Function>(defaultValue);
+    auto event = createEventImpl<Function>(true, validateOptimistic<Function>(expected));
+    if (!event)
+        return defaultValue;
+    postEventImpl(event);
+    return expected;
+}
+
 namespace QWebGL {
 #define EXPAND(x) x
 
@@ -561,20 +857,33 @@ QWEBGL_FUNCTION_POSTEVENT(blendFuncSeparate, glBlendFuncSeparate,
 QWEBGL_FUNCTION(bufferData, void, glBufferData,
                 (GLenum) target, (GLsizeiptr) size, (const void *) data, (GLenum) usage)
 {
-    postEvent<&bufferData>(target, usage, int(size), data ? QByteArray((const char *)data, size)
-                                                          : QByteArray());
+    auto event = createEventImpl<&bufferData>(false);
+    if (!event)
+        return;
+    event->addParameters(target, usage, int(size));
+    if (data)
+        addBufferPayload(event, target, (const char *)data, size);
+    else
+        event->addNull();
+    postEventImpl(event);
 }
 
 QWEBGL_FUNCTION(bufferSubData, void, glBufferSubData,
                 (GLenum) target, (GLintptr) offset, (GLsizeiptr) size, (const void *) data)
 {
-    postEvent<&bufferSubData>(target, int(offset), QByteArray((const char *)data, size));
+    auto event = createEventImpl<&bufferSubData>(false);
+    if (!event)
+        return;
+    event->addParameters(target, int(offset));
+    addBufferPayload(event, target, (const char *)data, size);
+    postEventImpl(event);
 }
 
 QWEBGL_FUNCTION(checkFramebufferStatus, GLenum, glCheckFramebufferStatus,
                 (GLenum) target)
 {
-    return postEventAndQuery<&checkFramebufferStatus>(0u, target);
+    return postEventAndQueryOptimistic<&checkFramebufferStatus>(GLenum(GL_FRAMEBUFFER_COMPLETE),
+                                                                0u, target);
 }
 
 QWEBGL_FUNCTION_POSTEVENT(clear, glClear, (GLbitfield) mask)
@@ -667,6 +976,10 @@ QWEBGL_FUNCTION(deleteTextures, void, glDeleteTextures,
                 (GLsizei) n, (const GLuint *) textures)
 {
     postEvent<&deleteTextures>(qMakePair(textures, n));
+    for (int i = 0; i < n; ++i) {
+        currentContextData()->atlasTextures.remove(textures[i]);
+        currentContextData()->reducedPrecisionTextures.remove(textures[i]);
+    }
 }
 
 QWEBGL_FUNCTION_POSTEVENT(depthFunc, glDepthFunc,
@@ -699,7 +1012,7 @@ QWEBGL_FUNCTION(drawArrays, void, glDrawArrays,
     // client-side ones need to transfer the data starting from the base
     // pointer, not just from 'first'.
     setVertexAttribs(event, first + count);
-    QCoreApplication::postEvent(QWebGLIntegrationPrivate::instance()->webSocketServer, event);
+    postEventImpl(event);
 }
 
 QWEBGL_FUNCTION(drawElements, void, glDrawElements,
@@ -712,12 +1025,13 @@ QWEBGL_FUNCTION(drawElements, void, glDrawElements,
     setVertexAttribs(event, count);
     ContextData *d = currentContextData();
     if (d->boundElementArrayBuffer == 0) {
-        event->addParameters(0, QByteArray(reinterpret_cast<const char *>(indices),
-                                           count * elementSize(type)));
+        event->addInt(0);
+        addIndexPayload(event, reinterpret_cast<const char *>(indices),
+                        count * elementSize(type), elementSize(type));
     } else {
         event->addParameters(1, uint(quintptr(indices)));
     }
-    QCoreApplication::postEvent(QWebGLIntegrationPrivate::instance()->webSocketServer, event);
+    postEventImpl(event);
 }
 
 QWEBGL_FUNCTION(enableVertexAttribArray, void, glEnableVertexAttribArray,
@@ -969,7 +1283,7 @@ QWEBGL_FUNCTION(getBufferParameteriv, void, glGetBufferParameteriv,
 
 QWEBGL_FUNCTION_NO_PARAMS(getError, GLenum, glGetError)
 {
-    return postEventAndQuery<&getError>(GL_NO_ERROR);
+    return postEventAndQueryOptimistic<&getError>(GLenum(GL_NO_ERROR), GLenum(GL_NO_ERROR));
 }
 
 QWEBGL_FUNCTION(getParameter, void, glGetFloatv,
@@ -996,7 +1310,10 @@ QWEBGL_FUNCTION(getProgramInfoLog, void, glGetProgramInfoLog,
 QWEBGL_FUNCTION(getProgramiv, void, glGetProgramiv,
                 (GLuint) program, (GLenum) pname, (GLint *) params)
 {
-    *params = postEventAndQuery<&getProgramiv>(0, program, pname);
+    if (pname == GL_LINK_STATUS)
+        *params = postEventAndQueryOptimistic<&getProgramiv>(GL_TRUE, 0, program, pname);
+    else
+        *params = postEventAndQuery<&getProgramiv>(0, program, pname);
 }
 
 QWEBGL_FUNCTION(getRenderbufferParameteriv, void, glGetRenderbufferParameteriv,
@@ -1055,7 +1372,10 @@ QWEBGL_FUNCTION(getShaderiv, void, glGetShaderiv,
         *params = bufSize;
         return;
     }
-    *params = postEventAndQuery<&getShaderiv>(0, shader, pname);
+    if (pname == GL_COMPILE_STATUS)
+        *params = postEventAndQueryOptimistic<&getShaderiv>(GL_TRUE, 0, shader, pname);
+    else
+        *params = postEventAndQuery<&getShaderiv>(0, shader, pname);
 }
 
 QWEBGL_FUNCTION(getTexParameterfv, void, glGetTexParameterfv,
@@ -1242,22 +1562,21 @@ QWEBGL_FUNCTION(texImage2D, void,  glTexImage2D,
                 (GLsizei) width, (GLsizei) height, (GLint) border, (GLenum) format, (GLenum) type,
                 (const void *) pixels)
 {
-    const auto data = reinterpret_cast<const char *>(pixels);
-    const auto dataSize = imageSize(width, height, format, type,
-                                    currentContextData()->pixelStorage);
-    const bool isNull = data == nullptr || [](const char *pointer, int size) {
-        const char *const end = pointer + size;
-        const unsigned int zero = 0u;
-        const char *const late = end + 1 - sizeof(zero);
-        while (pointer < late) { // we have at least sizeof(zero) more bytes to check:
-            if (*reinterpret_cast<const unsigned int *>(pointer) != zero)
-                return false;
-            pointer += sizeof(zero);
-        }
-        return pointer >= end || std::memcmp(pointer, &zero, end - pointer) == 0;
-    }(data, dataSize);
+    quint64 hash;
+    bool isNull;
+    const QByteArray data = uploadPixels(target, &internalformat, &format, &type, width, height,
+                                         pixels, &hash, &isNull);
+    if (isNull) {
+        postEvent<&texImage2D>(target, level, internalformat, width, height, border, format, type,
+                               nullptr);
+        return;
+    }
+    // Cube map faces are not tracked per texture, only plain 2D textures may be encoded lossy
+    const bool allowLossy = target == GL_TEXTURE_2D
+            && !currentContextData()->atlasTextures.contains(
+                    currentContextData()->boundTexture2D);
     postEvent<&texImage2D>(target, level, internalformat, width, height, border, format, type,
-                           isNull ? nullptr : QByteArray(data, dataSize));
+                           texturePayload(format, type, width, height, data, hash, allowLossy));
 }
 
 QWEBGL_FUNCTION_POSTEVENT(texParameterf, glTexParameterf,
@@ -1283,11 +1602,19 @@ QWEBGL_FUNCTION(texSubImage2D, void, glTexSubImage2D,
                 (GLsizei) width, (GLsizei) height, (GLenum) format, (GLenum) type,
                 (const void *) pixels)
 {
+    if (target == GL_TEXTURE_2D)
+        currentContextData()->atlasTextures.insert(currentContextData()->boundTexture2D);
+    quint64 hash;
+    bool isZero;
+    const QByteArray data = uploadPixels(target, nullptr, &format, &type, width, height, pixels,
+                                         &hash, &isZero);
+    if (!pixels) {
+        postEvent<&texSubImage2D>(target, level, xoffset, yoffset, width, height, format, type,
+                                  nullptr);
+        return;
+    }
     postEvent<&texSubImage2D>(target, level, xoffset, yoffset, width, height, format, type,
-                             pixels ? QByteArray(reinterpret_cast<const char *>(pixels),
-                                                 imageSize(width, height, format, type,
-                                                           currentContextData()->pixelStorage))
-                                    : nullptr);
+                              texturePayload(format, type, width, height, data, hash, false));
 }
 
 QWEBGL_FUNCTION_POSTEVENT(uniform1f, glUniform1f, (GLint) location, (GLfloat) v0)
@@ -1491,14 +1818,26 @@ QSurfaceFormat QWebGLContext::format() const
 
 void QWebGLContext::swapBuffers(QPlatformSurface *surface)
 {
-    Q_UNUSED(surface);
     auto event = createEvent(QStringLiteral("swapBuffers"), true);
     if (!event)
         return;
-    lockMutex();
-    QCoreApplication::postEvent(QWebGLIntegrationPrivate::instance()->webSocketServer, event);
-    waitCondition(1000);
-    unlockMutex();
+    if (QWebGLLatencyTracer::isEnabled()) {
+        // The browser reports when it executed the frame showing the traced input
+        auto integrationPrivate = QWebGLIntegrationPrivate::instance();
+        const auto clientData = integrationPrivate->findClientData(surface);
+        if (clientData) {
+            if (const auto sequence = integrationPrivate->latencyTracer.frameSwapped(
+                        clientData->socket)) {
+                event->addUInt(sequence);
+            }
+        }
+    }
+    const int id = event->id();
+    postEventImpl(event);
+    QWebGLFrameArena::endFrame();
+    QWebGLTrace::Span span("swapWait");
+    QVariant value;
+    QWebGLContextPrivate::responseToken()->wait(id, &value, 1000);
 }
 
 bool QWebGLContext::makeCurrent(QPlatformSurface *surface)
@@ -1522,14 +1861,16 @@ bool QWebGLContext::makeCurrent(QPlatformSurface *surface)
     if (surface->surface()->surfaceClass() == QSurface::Window) {
         auto window = static_cast<QWebGLWindow *>(surface);
         if (s_contextData[id()].cachedParameters.isEmpty()) {
-            auto future = window->d_func()->defaults.get_future();
-            std::future_status status = std::future_status::timeout;
-            while (status == std::future_status::timeout) {
+            // Normally ready at once, the parameters come with the connect message. A disconnect
+            // completes the future as well, the timeout only covers windows without a client.
+            const auto future = window->d_func()->defaultsFuture;
+            while (future.wait_for(std::chrono::seconds(1)) == std::future_status::timeout) {
                 if (!QWebGLIntegrationPrivate::instance()->findClientData(surface))
                     return false;
-                status = future.wait_for(std::chrono::milliseconds(100));
             }
-            s_contextData[id()].cachedParameters  = future.get();
+            if (future.get().isEmpty())
+                return false;
+            s_contextData[id()].cachedParameters = future.get();
         }
         event->addInt(window->window()->width());
         event->addInt(window->window()->height());
@@ -1537,7 +1878,7 @@ bool QWebGLContext::makeCurrent(QPlatformSurface *surface)
     } else if (surface->surface()->surfaceClass() == QSurface::Offscreen) {
         qCDebug(lc, "QWebGLContext::makeCurrent: QSurface::Offscreen not implemented");
     }
-    QCoreApplication::postEvent(QWebGLIntegrationPrivate::instance()->webSocketServer, event);
+    postEventImpl(event);
     return true;
 }
 
@@ -1570,6 +1911,62 @@ QPlatformSurface *QWebGLContext::currentSurface() const
     return d->currentSurface;
 }
 
+void QWebGLContext::setTextureReducedPrecision(GLuint texture, bool enabled)
+{
+    auto contextData = currentContextData();
+    if (!contextData) {
+        qCWarning(lc, "setTextureReducedPrecision called without a current context");
+        return;
+    }
+    if (enabled)
+        contextData->reducedPrecisionTextures.insert(texture);
+    else
+        contextData->reducedPrecisionTextures.remove(texture);
+}
+
+bool QWebGLContext::readPixelsAsync(const QRect &rect, ReadPixelsCallback callback,
+                                    void *userData)
+{
+    auto context = QOpenGLContext::currentContext();
+    const auto handle = context ? static_cast<QWebGLContext *>(context->handle()) : nullptr;
+    if (!handle || !callback) {
+        qCWarning(lc, "readPixelsAsync called without a current context or a callback");
+        return false;
+    }
+    auto integrationPrivate = QWebGLIntegrationPrivate::instance();
+    const auto clientData = integrationPrivate->findClientData(handle->currentSurface());
+    if (!clientData || !clientData->connectedSocket.loadAcquire())
+        return false;
+
+    // The call keeps its place in the command stream, so the pixels are those of the frame
+    // being recorded, while the render thread carries on with the next frames. The client
+    // answers with the raw bytes in a binary gl_response.
+    const GLsizei width = rect.width();
+    const GLsizei height = rect.height();
+    const auto event = new QWebGLFunctionCall(QWebGL::readPixels.localName,
+                                              handle->currentSurface(), true);
+    integrationPrivate->expectResponse(event->id(), *clientData,
+                                       [=](const QVariant &value) {
+        const QByteArray pixels = value.toByteArray();
+        QImage image;
+        if (pixels.size() == width * height * 4) {
+            image = QImage(reinterpret_cast<const uchar *>(pixels.constData()), width, height,
+                           QImage::Format_RGBA8888).mirrored();
+        }
+        QMetaObject::invokeMethod(qGuiApp, [=]() { callback(image, userData); },
+                                  Qt::QueuedConnection);
+    });
+    addHelper(event, GLint(rect.x()), GLint(rect.y()), width, height, GLenum(GL_RGBA),
+              GLenum(GL_UNSIGNED_BYTE));
+    postEventImpl(event);
+    return true;
+}
+
+int QWebGLContext::optimisticQueryMismatches()
+{
+    return QWebGLContextPrivate::optimisticQueryMismatches.loadAcquire();
+}
+
 QWebGLFunctionCall *QWebGLContext::createEvent(const QString &functionName, bool wait)
 {
     auto context = QOpenGLContext::currentContext();
@@ -1579,43 +1976,26 @@ QWebGLFunctionCall *QWebGLContext::createEvent(const QString &functionName, bool
         return nullptr;
     auto integrationPrivate = QWebGLIntegrationPrivate::instance();
     const auto clientData = integrationPrivate->findClientData(handle->currentSurface());
-    if (!clientData || !clientData->socket
-            || clientData->socket->state() != QAbstractSocket::ConnectedState)
+    if (!clientData || !clientData->connectedSocket.loadAcquire())
         return nullptr;
     const auto pointer = new QWebGLFunctionCall(functionName, handle->currentSurface(), wait);
     if (wait)
-        QWebGLContextPrivate::waitingIds.insert(pointer->id());
+        QWebGLContextPrivate::expectResponse(pointer, *clientData);
 
     return pointer;
 }
 
 QVariant QWebGLContext::queryValue(int id)
 {
-    if (!QWebGLContextPrivate::waitingIds.contains(id)) {
+    // The response or a disconnection completes the token, see
+    // QWebGLIntegrationPrivate::expectResponse
+    QWebGLTrace::Span span("queryWait");
+    QVariant value;
+    if (!QWebGLContextPrivate::responseToken()->wait(id, &value)) {
         qCWarning(lc, "Unexpected id (%d)", id);
         return QVariant();
     }
-
-    static auto queryValue = [](int id)
-    {
-        lockMutex();
-        waitCondition(10);
-        unlockMutex();
-        return QWebGLIntegrationPrivate::instance()->webSocketServer->queryValue(id);
-    };
-
-    const auto handle = static_cast<QWebGLContext *>(currentContext()->context()->handle());
-    QVariant variant = queryValue(id);
-    while (variant.isNull()) {
-        auto integrationPrivate = QWebGLIntegrationPrivate::instance();
-        const auto clientData = integrationPrivate->findClientData(handle->currentSurface());
-        if (!clientData || !clientData->socket
-                || clientData->socket->state() != QAbstractSocket::ConnectedState)
-            return QVariant();
-        variant = queryValue(id);
-    }
-    QWebGLContextPrivate::waitingIds.remove(id);
-    return variant;
+    return value;
 }
 
 QStringList QWebGLContext::supportedFunctions()
@@ -34,6 +34,8 @@
 
 QT_BEGIN_NAMESPACE
 
+class QImage;
+class QRect;
 class QWebGLFunctionCall;
 class QWebGLContextPrivate;
 
@@ -57,6 +59,21 @@ public:
     int id() const;
     QPlatformSurface *currentSurface() const;
 
+    // Allows uploads to 'texture' in the current context to be sent as RGBA4444, RGB565 or
+    // half floats. Exposed through the native interface as "setTextureReducedPrecision".
+    static void setTextureReducedPrecision(GLuint texture, bool enabled);
+
+    // Queues a glReadPixels of 'rect' in the framebuffer bound in the current context without
+    // blocking the render thread. 'callback' is invoked on the GUI thread with the RGBA image
+    // (top-down), or a null image if the client disconnected. Exposed through the native
+    // interface as "readPixelsAsync".
+    using ReadPixelsCallback = void (*)(const QImage &image, void *userData);
+    static bool readPixelsAsync(const QRect &rect, ReadPixelsCallback callback, void *userData);
+
+    // Number of optimistic status queries whose real answer differed from the assumed success
+    // value. Exposed through the native interface as "optimisticQueryMismatches".
+    static int optimisticQueryMismatches();
+
     static QWebGLFunctionCall *createEvent(const QString &functionName, bool wait = false);
     static QVariant queryValue(int id);
 
@@ -0,0 +1,174 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qwebglframearena.h"
+
+#include <QtCore/qatomic.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qvector.h>
+
+#include <new>
+
+QT_BEGIN_NAMESPACE
+
+namespace QWebGLFrameArena
+{
+
+namespace {
+
+const std::size_t blockSize = 64 * 1024;
+const std::size_t maxAllocationSize = 4 * 1024; // larger allocations use the heap
+const int maxPooledBlocks = 64;
+
+struct alignas(16) Block
+{
+    QAtomicInt references; // one per live allocation, plus one while a thread allocates from it
+    char *cursor;
+    char *end;
+};
+
+struct alignas(16) AllocationHeader
+{
+    Block *block; // nullptr for heap allocations
+};
+
+struct BlockPool
+{
+    ~BlockPool()
+    {
+        for (auto block : qAsConst(blocks))
+            ::operator delete(block);
+    }
+
+    QMutex mutex;
+    QVector<Block *> blocks;
+};
+
+Q_GLOBAL_STATIC(BlockPool, blockPool)
+
+std::size_t alignedSize(std::size_t size)
+{
+    return (size + 15) & ~std::size_t(15);
+}
+
+Block *acquireBlock()
+{
+    Block *block = nullptr;
+    if (auto pool = blockPool()) {
+        QMutexLocker locker(&pool->mutex);
+        if (!pool->blocks.isEmpty())
+            block = pool->blocks.takeLast();
+    }
+    if (!block)
+        block = static_cast<Block *>(::operator new(blockSize));
+    block->references.storeRelaxed(1);
+    block->cursor = reinterpret_cast<char *>(block) + sizeof(Block);
+    block->end = reinterpret_cast<char *>(block) + blockSize;
+    return block;
+}
+
+void recycleBlock(Block *block)
+{
+    if (auto pool = blockPool()) {
+        QMutexLocker locker(&pool->mutex);
+        if (pool->blocks.size() < maxPooledBlocks) {
+            pool->blocks.append(block);
+            return;
+        }
+    }
+    ::operator delete(block);
+}
+
+void unrefBlock(Block *block)
+{
+    if (!block->references.deref())
+        recycleBlock(block);
+}
+
+struct ThreadArena
+{
+    ~ThreadArena()
+    {
+        if (current)
+            unrefBlock(current);
+    }
+
+    Block *current = nullptr;
+};
+
+thread_local ThreadArena threadArena;
+
+}
+
+void *allocate(std::size_t size)
+{
+    const std::size_t total = sizeof(AllocationHeader) + alignedSize(size);
+    AllocationHeader *header;
+    if (total > maxAllocationSize) {
+        header = static_cast<AllocationHeader *>(::operator new(total));
+        header->block = nullptr;
+        return header + 1;
+    }
+
+    auto &arena = threadArena;
+    if (!arena.current || std::size_t(arena.current->end - arena.current->cursor) < total) {
+        if (arena.current)
+            unrefBlock(arena.current);
+        arena.current = acquireBlock();
+    }
+    header = reinterpret_cast<AllocationHeader *>(arena.current->cursor);
+    header->block = arena.current;
+    arena.current->cursor += total;
+    arena.current->references.ref();
+    return header + 1;
+}
+
+void release(void *pointer)
+{
+    if (!pointer)
+        return;
+    const auto header = static_cast<AllocationHeader *>(pointer) - 1;
+    if (header->block)
+        unrefBlock(header->block);
+    else
+        ::operator delete(header);
+}
+
+void endFrame()
+{
+    auto &arena = threadArena;
+    if (arena.current) {
+        unrefBlock(arena.current);
+        arena.current = nullptr;
+    }
+}
+
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,56 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QWEBGLFRAMEARENA_H
+#define QWEBGLFRAMEARENA_H
+
+#include <QtCore/qglobal.h>
+
+#include <cstddef>
+
+QT_BEGIN_NAMESPACE
+
+// Allocator for the short lived objects of a frame (function calls and small payloads). They
+// are created by the rendering thread and destroyed by the WebSocket thread right after being
+// sent. Allocations are carved from thread local blocks, and a block returns to a shared pool
+// once everything allocated from it has been released.
+namespace QWebGLFrameArena
+{
+
+void *allocate(std::size_t size);
+void release(void *pointer);
+
+// Stops allocating from the current block, so that it is recycled as soon as the frame is sent
+void endFrame();
+
+}
+
+QT_END_NAMESPACE
+
+#endif // QWEBGLFRAMEARENA_H
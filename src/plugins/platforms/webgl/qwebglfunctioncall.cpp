@@ -29,20 +29,40 @@
 
 #include "qwebglfunctioncall.h"
 
+#include "qwebglframearena.h"
+
 #include <QtCore/qjsonobject.h>
 #include <QtCore/qjsonvalue.h>
 #include <QtCore/qstring.h>
 #include <QtCore/qthread.h>
+#include <QtCore/qvarlengtharray.h>
 #include <QtGui/qpa/qplatformsurface.h>
 
+#include <cstring>
+
 QT_BEGIN_NAMESPACE
 
+// Payloads up to this size are copied into the frame arena, so that neither the call nor its
+// data cause a heap free on the WebSocket thread
+static const int maxArenaPayloadSize = 1024;
+
 class QWebGLFunctionCallPrivate
 {
 public:
+    ~QWebGLFunctionCallPrivate()
+    {
+        for (auto payload : qAsConst(arenaPayloads))
+            QWebGLFrameArena::release(payload);
+    }
+
+    static void *operator new(std::size_t size) { return QWebGLFrameArena::allocate(size); }
+    static void operator delete(void *pointer) { QWebGLFrameArena::release(pointer); }
+
     QString functionName;
     QPlatformSurface *surface = nullptr;
-    QVariantList parameters;
+    QVarLengthArray<QVariant, 12> parameters;
+    QVarLengthArray<void *, 4> arenaPayloads;
+    QByteArray message;
     bool wait = false;
     int id = -1;
     QThread *thread = nullptr;
@@ -71,6 +91,16 @@ QWebGLFunctionCall::QWebGLFunctionCall(const QString &functionName,
 QWebGLFunctionCall::~QWebGLFunctionCall()
 {}
 
+void *QWebGLFunctionCall::operator new(std::size_t size)
+{
+    return QWebGLFrameArena::allocate(size);
+}
+
+void QWebGLFunctionCall::operator delete(void *pointer)
+{
+    QWebGLFrameArena::release(pointer);
+}
+
 QEvent::Type QWebGLFunctionCall::type()
 {
     return Type(QWebGLFunctionCallPrivate::type);
@@ -133,7 +163,28 @@ void QWebGLFunctionCall::addFloat(float value)
 void QWebGLFunctionCall::addData(const QByteArray &data)
 {
     Q_D(QWebGLFunctionCall);
-    d->parameters.append(data);
+    if (data.isEmpty() || data.size() > maxArenaPayloadSize)
+        d->parameters.append(data); // Shared, not copied
+    else
+        addData(data.constData(), data.size());
+}
+
+void QWebGLFunctionCall::addData(const void *data, int size)
+{
+    Q_D(QWebGLFunctionCall);
+    if (size <= 0) {
+        d->parameters.append(QByteArray());
+        return;
+    }
+    if (size > maxArenaPayloadSize) {
+        d->parameters.append(QByteArray(static_cast<const char *>(data), size));
+        return;
+    }
+    // The raw data is only read while serializing this call, before it is destroyed
+    auto payload = QWebGLFrameArena::allocate(size);
+    std::memcpy(payload, data, size);
+    d->arenaPayloads.append(payload);
+    d->parameters.append(QByteArray::fromRawData(static_cast<const char *>(payload), size));
 }
 
 void QWebGLFunctionCall::addList(const QVariantList &list)
@@ -142,6 +193,12 @@ void QWebGLFunctionCall::addList(const QVariantList &list)
     d->parameters.append(QVariant::fromValue(list));
 }
 
+void QWebGLFunctionCall::addVariant(const QVariant &value)
+{
+    Q_D(QWebGLFunctionCall);
+    d->parameters.append(value);
+}
+
 void QWebGLFunctionCall::addNull()
 {
     Q_D(QWebGLFunctionCall);
@@ -151,7 +208,19 @@ void QWebGLFunctionCall::addNull()
 QVariantList QWebGLFunctionCall::parameters() const
 {
     Q_D(const QWebGLFunctionCall);
-    return d->parameters;
+    return QVariantList(d->parameters.cbegin(), d->parameters.cend());
+}
+
+QByteArray QWebGLFunctionCall::message() const
+{
+    Q_D(const QWebGLFunctionCall);
+    return d->message;
+}
+
+void QWebGLFunctionCall::setMessage(const QByteArray &message)
+{
+    Q_D(QWebGLFunctionCall);
+    d->message = message;
 }
 
 QT_END_NAMESPACE
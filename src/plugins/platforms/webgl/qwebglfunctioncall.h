@@ -34,6 +34,7 @@
 #include <QtCore/qscopedpointer.h>
 #include <QtCore/qvariant.h>
 
+#include <cstddef>
 #include <tuple>
 
 QT_BEGIN_NAMESPACE
@@ -50,6 +51,9 @@ public:
     QWebGLFunctionCall(const QString &functionName, QPlatformSurface *surface, bool wait = false);
     ~QWebGLFunctionCall() override;
 
+    static void *operator new(std::size_t size);
+    static void operator delete(void *pointer);
+
     static Type type();
 
     int id() const;
@@ -64,7 +68,9 @@ public:
     void addUInt(uint value);
     void addFloat(float value);
     void addData(const QByteArray &data);
+    void addData(const void *data, int size);
     void addList(const QVariantList &list);
+    void addVariant(const QVariant &value);
     void addNull();
 
     void add(const QString &value) { addString(value); }
@@ -74,6 +80,7 @@ public:
     void add(float value) { addFloat(value); }
     void add(const QByteArray &data) { addData(data); }
     void add(const QVariantList &list) { addList(list); }
+    void add(const QVariant &value) { addVariant(value); }
     void add(std::nullptr_t) { addNull(); }
 
     template<class...Ts>
@@ -84,6 +91,10 @@ public:
 
     QVariantList parameters() const;
 
+    // The serialized gl_command, when the posting thread already encoded it
+    QByteArray message() const;
+    void setMessage(const QByteArray &message);
+
 protected:
     template<typename T>
     void addImpl(T first)
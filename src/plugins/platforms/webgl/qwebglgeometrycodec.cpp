@@ -0,0 +1,126 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qwebglgeometrycodec.h"
+
+#include <QtCore/qendian.h>
+#include <QtCore/qloggingcategory.h>
+
+#include <cstring>
+
+QT_BEGIN_NAMESPACE
+
+static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.geometrycodec")
+
+namespace QWebGLGeometryCodec
+{
+
+// Smaller buffers are sent raw, encoding them does not pay off
+static const int minimumSize = 1024;
+
+bool isEnabled()
+{
+    static const bool enabled = []() {
+        const auto value = qgetenv("QT_WEBGL_GEOMETRY_CODEC");
+        return !value.isEmpty() && value != "0";
+    }();
+    return enabled;
+}
+
+bool encodeIndices(const char *data, int size, int indexSize, EncodedBuffer *result)
+{
+    if (!data || size < minimumSize || (indexSize != 2 && indexSize != 4) || size % indexSize)
+        return false;
+
+    const int count = size / indexSize;
+    // Every zigzag encoded delta of a 32 bit index fits in 5 varint bytes
+    result->data.resize(count * 5);
+    auto out = reinterpret_cast<uchar *>(result->data.data());
+    qint64 previous = 0;
+    for (int i = 0; i < count; ++i) {
+        const qint64 value = indexSize == 2
+                ? qint64(qFromUnaligned<quint16>(data + i * indexSize))
+                : qint64(qFromUnaligned<quint32>(data + i * indexSize));
+        const qint64 delta = value - previous;
+        previous = value;
+        quint64 zigzag = (quint64(delta) << 1) ^ quint64(delta >> 63);
+        while (zigzag >= 0x80) {
+            *out++ = uchar(zigzag | 0x80);
+            zigzag >>= 7;
+        }
+        *out++ = uchar(zigzag);
+    }
+    const int encodedSize = int(out - reinterpret_cast<uchar *>(result->data.data()));
+    if (encodedSize >= size) {
+        result->data.clear();
+        return false;
+    }
+    result->data.resize(encodedSize);
+    result->kind = EncodedBuffer::Indices;
+    result->elementSize = quint8(indexSize);
+    result->count = quint32(count);
+    qCDebug(lc, "Encoded %d indices: %d -> %d bytes", count, size, encodedSize);
+    return true;
+}
+
+bool encodeVertices(const char *data, int size, int elementSize, EncodedBuffer *result)
+{
+    if (!data || size < minimumSize || (elementSize != 2 && elementSize != 4))
+        return false;
+
+    // Group the n-th byte of every element together: sign/exponent bytes of neighboring floats
+    // are usually equal and compress much better than the interleaved representation.
+    const int count = size / elementSize;
+    QByteArray shuffled(size, Qt::Uninitialized);
+    for (int plane = 0; plane < elementSize; ++plane) {
+        char *out = shuffled.data() + plane * count;
+        const char *in = data + plane;
+        for (int i = 0; i < count; ++i, in += elementSize)
+            out[i] = *in;
+    }
+    const int tail = size - count * elementSize;
+    if (tail)
+        std::memcpy(shuffled.data() + count * elementSize, data + count * elementSize, tail);
+
+    // qCompress prefixes the zlib stream with the uncompressed size, the browser only needs the
+    // zlib stream itself.
+    const QByteArray compressed = qCompress(shuffled);
+    if (compressed.size() - 4 >= size)
+        return false;
+    result->data = compressed.mid(4);
+    result->kind = EncodedBuffer::Vertices;
+    result->elementSize = quint8(elementSize);
+    result->count = quint32(size);
+    qCDebug(lc, "Encoded vertex data: %d -> %d bytes", size, result->data.size());
+    return true;
+}
+
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,63 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QWEBGLGEOMETRYCODEC_H
+#define QWEBGLGEOMETRYCODEC_H
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qmetatype.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QWebGLGeometryCodec
+{
+
+struct EncodedBuffer
+{
+    enum Kind : quint8 {
+        Indices = 'v',  // delta + zigzag + varint
+        Vertices = 'z'  // byte-plane shuffle + deflate
+    } kind = Indices;
+    quint8 elementSize = 0;
+    quint32 count = 0;  // number of indices or number of decoded bytes
+    QByteArray data;
+};
+
+bool isEnabled();
+
+bool encodeIndices(const char *data, int size, int indexSize, EncodedBuffer *result);
+bool encodeVertices(const char *data, int size, int elementSize, EncodedBuffer *result);
+
+}
+
+QT_END_NAMESPACE
+
+Q_DECLARE_METATYPE(QWebGLGeometryCodec::EncodedBuffer)
+
+#endif // QWEBGLGEOMETRYCODEC_H
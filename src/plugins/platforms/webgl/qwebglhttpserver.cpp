@@ -29,46 +29,80 @@
 
 #include "qwebglhttpserver.h"
 
+#include "qwebglcontext.h"
 #include "qwebglintegration.h"
 #include "qwebglwebsocketserver.h"
 
 #include <QtCore/qbuffer.h>
 #include <QtCore/qbytearray.h>
+#include <QtCore/qcryptographichash.h>
+#include <QtCore/qendian.h>
 #include <QtCore/qfile.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qjsonarray.h>
+#include <QtCore/qjsondocument.h>
 #include <QtCore/qpointer.h>
+#include <QtCore/qsharedpointer.h>
 #include <QtCore/qtimer.h>
 #include <QtCore/qurlquery.h>
 #include <QtGui/qclipboard.h>
 #include <QtGui/qicon.h>
 #include <QtGui/qguiapplication.h>
+#include <QtNetwork/qlocalserver.h>
 #include <QtNetwork/qnetworkinterface.h>
 #include <QtNetwork/qtcpserver.h>
 #include <QtNetwork/qtcpsocket.h>
 
+#include <array>
 #include <cctype>
 #include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#if defined(Q_OS_UNIX)
+#include <unistd.h>
+#endif
 
 QT_BEGIN_NAMESPACE
 
 static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.httpserver")
 
+// Requests whose head does not fit are rejected, configurable for clients sending big cookies
+static int maxHeaderSize()
+{
+    static const int size = []() {
+        bool ok = false;
+        const int value = qEnvironmentVariableIntValue("QT_WEBGL_HTTP_MAX_HEADER_SIZE", &ok);
+        return ok && value > 0 ? value : 16 * 1024;
+    }();
+    return size;
+}
+
+// Persistent connections are closed after this many requests or this long without one
+static const int maxRequestsPerConnection = 100;
+static const int keepAliveTimeout = 5000;
+
+// A streamed device is read no further while this much is waiting to be sent to the client
+static const qint64 maxStreamBacklog = 64 * 1024;
+
 struct HttpRequest {
     quint16 port = 0;
 
-    bool readMethod(QTcpSocket *socket);
-    bool readUrl(QTcpSocket *socket);
-    bool readStatus(QTcpSocket *socket);
-    bool readHeader(QTcpSocket *socket);
+    bool parse();
+    QByteArray header(const QByteArray &name) const;
+    bool isKeepAlive() const;
+    bool parseRequestLine(const char *begin, const char *end);
+    bool parseHeader(const char *begin, const char *end);
 
     enum class State {
-        ReadingMethod,
-        ReadingUrl,
-        ReadingStatus,
+        ReadingRequestLine,
         ReadingHeader,
         ReadingBody,
         AllDone
-    } state = State::ReadingMethod;
-    QByteArray fragment;
+    } state = State::ReadingRequestLine;
+    QByteArray buffer;
+    int parsed = 0; // bytes of buffer consumed by complete lines
+    int scanned = 0; // bytes of buffer known to hold no further line end
 
     enum class Method {
         Unknown,
@@ -78,21 +112,247 @@ struct HttpRequest {
         Post,
         Delete,
     } method = Method::Unknown;
-    quint32 byteSize = 0;
     QUrl url;
     QPair<quint8, quint8> version;
     QMap<QByteArray, QByteArray> headers;
 };
 
+struct HttpConnection {
+    HttpRequest request;
+    int answered = 0;
+};
+
+#if QT_CONFIG(localserver) && defined(Q_OS_UNIX)
+// Wraps the accepted Unix domain sockets in QTcpSocket, which handles any stream socket. The
+// rest of the server, WebSocket upgrades included, does not tell the connections apart.
+class LocalServer : public QLocalServer
+{
+public:
+    explicit LocalServer(QWebGLHttpServer *httpServer) :
+        QLocalServer(httpServer),
+        httpServer(httpServer)
+    {}
+
+protected:
+    void incomingConnection(quintptr socketDescriptor) override
+    {
+        auto socket = new QTcpSocket(this);
+        if (socket->setSocketDescriptor(qintptr(socketDescriptor))) {
+            httpServer->acceptClient(socket);
+        } else {
+            qCWarning(lc, "Invalid local connection: %s", qPrintable(socket->errorString()));
+            ::close(int(socketDescriptor));
+            delete socket;
+        }
+    }
+
+private:
+    QWebGLHttpServer *httpServer;
+};
+#endif
+
+// A static resource, built once and answered from memory
+struct HttpAsset {
+    QByteArray contentType;
+    QByteArray cacheControl;
+    QByteArray etag;
+    QByteArray data;
+    QByteArray gzipData; // empty when compressing does not pay off
+};
+
 class QWebGLHttpServerPrivate
 {
 public:
-    QMap<QTcpSocket *, HttpRequest> clients;
+    const HttpAsset *asset(const QString &path);
+
+    QMap<QTcpSocket *, HttpConnection> clients;
+    QHash<QString, HttpAsset> assets;
+    qint64 windowIconKey = 0;
     QMap<QString, QPointer<QIODevice>> customRequestDevices;
     QTcpServer server;
+#if QT_CONFIG(localserver) && defined(Q_OS_UNIX)
+    LocalServer *localServer = nullptr;
+#endif
     QPointer<QWebGLWebSocketServer> webSocketServer;
 };
 
+static quint32 crc32(const QByteArray &data)
+{
+    static const auto table = []() {
+        std::array<quint32, 256> table;
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 c = i;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        return table;
+    }();
+    quint32 crc = 0xffffffffu;
+    for (const char c : data)
+        crc = table[(crc ^ quint8(c)) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+static QByteArray gzip(const QByteArray &data)
+{
+    // qCompress writes the uncompressed size, a 2 byte zlib header, the deflate stream and a
+    // 4 byte Adler-32 checksum. The deflate stream is reused between a gzip header and trailer.
+    const QByteArray compressed = qCompress(data, 9);
+    QByteArray gzip("\x1f\x8b\x08\x00\x00\x00\x00\x00\x02\xff", 10);
+    gzip.append(compressed.constData() + 6, compressed.size() - 10);
+    char trailer[8];
+    qToLittleEndian(crc32(data), trailer);
+    qToLittleEndian(quint32(data.size()), trailer + 4);
+    gzip.append(trailer, sizeof(trailer));
+    return gzip;
+}
+
+static HttpAsset createAsset(const QByteArray &contentType, const QByteArray &cacheControl,
+                             const QByteArray &data)
+{
+    HttpAsset asset;
+    asset.contentType = contentType;
+    asset.cacheControl = cacheControl;
+    asset.etag = '"' + QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex() + '"';
+    asset.data = data;
+    if (!contentType.startsWith("image/")) {
+        const auto compressed = gzip(data);
+        if (compressed.size() < data.size())
+            asset.gzipData = compressed;
+    }
+    return asset;
+}
+
+static QByteArray readResource(const QString &fileName)
+{
+    QFile file(fileName);
+    Q_ASSERT(file.exists());
+    file.open(QIODevice::ReadOnly);
+    Q_ASSERT(file.isOpen());
+    return file.readAll();
+}
+
+const HttpAsset *QWebGLHttpServerPrivate::asset(const QString &path)
+{
+    // The page and the script depend on this instance, browsers revalidate them with the ETag
+    static const QByteArray revalidate = QByteArrayLiteral("no-cache");
+    if (path == QLatin1String("/favicon.png")) {
+        // Rendered again only when the application changes its icon
+        const auto icon = qGuiApp->windowIcon();
+        if (!assets.contains(path) || icon.cacheKey() != windowIconKey) {
+            QBuffer buffer;
+            icon.pixmap(16, 16).save(&buffer, "png");
+            windowIconKey = icon.cacheKey();
+            assets.insert(path, createAsset(QByteArrayLiteral("image/x-icon"), revalidate,
+                                            buffer.data()));
+        }
+        return &assets[path];
+    }
+
+    auto it = assets.constFind(path);
+    if (it != assets.cend())
+        return &*it;
+    if (path == QLatin1String("/")) {
+        it = assets.insert(path, createAsset(QByteArrayLiteral("text/html; charset=\"utf-8\""),
+                                             revalidate,
+                                             readResource(QStringLiteral(":/webgl/index.html"))));
+    } else if (path == QLatin1String("/webqt.js")) {
+        // Built on first use, once the WebSocket server has its port. Behind a session manager
+        // the browser reaches the WebSocket server through its proxy.
+        const QByteArray publicPort = qgetenv("QT_WEBGL_PUBLIC_WEBSOCKET_PORT");
+        const auto port = publicPort.isEmpty()
+                ? QString::number(webSocketServer->port()).toUtf8() : publicPort;
+        QByteArray data = "var host = window.location.hostname;\r\nvar port = " +
+                (QWebGLWebSocketServer::isSinglePort()
+                 ? QByteArrayLiteral("window.location.port || "
+                                     "(window.location.protocol === \"https:\" ? 443 : 80)")
+                 : port) + ";\r\n";
+        // Baking the function table into the script lets the browser decode commands without
+        // waiting for the connect message
+        data += "var supportedFunctions = " + QJsonDocument(
+                    QJsonArray::fromStringList(QWebGLContext::supportedFunctions()))
+                .toJson(QJsonDocument::Compact) + ";\r\n";
+        data += readResource(QStringLiteral(":/webgl/webqt.jsx"));
+        it = assets.insert(path, createAsset(QByteArrayLiteral("application/javascript"),
+                                             revalidate, data));
+    } else if (path == QLatin1String("/favicon.ico")) {
+        it = assets.insert(path, createAsset(QByteArrayLiteral("image/x-icon"),
+                                             QByteArrayLiteral("public, max-age=86400"),
+                                             readResource(QStringLiteral(":/webgl/favicon.ico"))));
+    } else {
+        return nullptr;
+    }
+    return &*it;
+}
+
+static void streamDevice(QTcpSocket *socket, QIODevice *device, bool chunked)
+{
+    struct Stream
+    {
+        QPointer<QIODevice> device;
+        QByteArray tail; // left in the device when it finished
+        int tailOffset = 0;
+        bool finished = false;
+        bool ended = false;
+    };
+    const auto stream = QSharedPointer<Stream>::create();
+    stream->device = device;
+
+    // Data is forwarded as soon as the device has it, but stays in the device while the client
+    // has not received the previous data. The response ends once everything is written.
+    const auto forward = [socket, stream, chunked]()
+    {
+        if (stream->ended || socket->state() != QAbstractSocket::ConnectedState)
+            return;
+        while (socket->bytesToWrite() < maxStreamBacklog) {
+            QByteArray data;
+            if (stream->tailOffset < stream->tail.size()) {
+                data = stream->tail.mid(stream->tailOffset, int(maxStreamBacklog));
+                stream->tailOffset += data.size();
+            } else if (stream->device && stream->device->bytesAvailable() > 0) {
+                data = stream->device->read(maxStreamBacklog);
+            }
+            if (data.isEmpty())
+                break;
+            if (chunked) {
+                socket->write(QByteArray::number(data.size(), 16) + QByteArrayLiteral("\r\n") +
+                              data + QByteArrayLiteral("\r\n"));
+            } else {
+                socket->write(data);
+            }
+        }
+        if (stream->finished && stream->tailOffset == stream->tail.size()
+                && socket->bytesToWrite() == 0) {
+            stream->ended = true;
+            if (chunked)
+                socket->write(QByteArrayLiteral("0\r\n\r\n"));
+            socket->disconnectFromHost();
+        }
+    };
+    const auto finish = [stream, forward]()
+    {
+        if (stream->finished)
+            return;
+        stream->finished = true;
+        if (stream->device)
+            stream->tail += stream->device->readAll(); // held back by the backlog limit
+        forward();
+    };
+    // The device may be gone before the client received everything, the socket drives the rest
+    QObject::connect(device, &QIODevice::readyRead, socket, forward);
+    QObject::connect(socket, &QIODevice::bytesWritten, socket, forward);
+    QObject::connect(device, &QIODevice::readChannelFinished, socket, finish);
+    QObject::connect(device, &QIODevice::aboutToClose, socket, finish);
+    QObject::connect(device, &QObject::destroyed, socket, [stream, forward]()
+    {
+        stream->device = nullptr; // nothing can be read from it anymore
+        stream->finished = true;
+        forward();
+    });
+    forward();
+}
+
 QWebGLHttpServer::QWebGLHttpServer(QWebGLWebSocketServer *webSocketServer, QObject *parent) :
     QObject(parent),
     d_ptr(new QWebGLHttpServerPrivate)
@@ -114,9 +374,29 @@ bool QWebGLHttpServer::listen(const QHostAddress &address, quint16 port)
     return ok;
 }
 
+bool QWebGLHttpServer::listen(const QString &name)
+{
+    Q_D(QWebGLHttpServer);
+#if QT_CONFIG(localserver) && defined(Q_OS_UNIX)
+    d->localServer = new LocalServer(this);
+    QLocalServer::removeServer(name);
+    const auto ok = d->localServer->listen(name);
+    qCDebug(lc, "Listening in %s", qPrintable(d->localServer->fullServerName()));
+    return ok;
+#else
+    Q_UNUSED(d);
+    qCWarning(lc, "Listening in %s is not supported on this platform", qPrintable(name));
+    return false;
+#endif
+}
+
 bool QWebGLHttpServer::isListening() const
 {
     Q_D(const QWebGLHttpServer);
+#if QT_CONFIG(localserver) && defined(Q_OS_UNIX)
+    if (d->localServer)
+        return d->localServer->isListening();
+#endif
     return d->server.isListening();
 }
 
@@ -143,15 +423,32 @@ void QWebGLHttpServer::setCustomRequestDevice(const QString &name, QIODevice *de
 QString QWebGLHttpServer::errorString() const
 {
     Q_D(const QWebGLHttpServer);
+#if QT_CONFIG(localserver) && defined(Q_OS_UNIX)
+    if (d->localServer)
+        return d->localServer->errorString();
+#endif
     return d->server.errorString();
 }
 
 void QWebGLHttpServer::clientConnected()
 {
     Q_D(QWebGLHttpServer);
-    auto socket = d->server.nextPendingConnection();
+    while (auto socket = d->server.nextPendingConnection())
+        acceptClient(socket);
+}
+
+void QWebGLHttpServer::acceptClient(QTcpSocket *socket)
+{
     connect(socket, &QTcpSocket::disconnected, this, &QWebGLHttpServer::clientDisconnected);
     connect(socket, &QTcpSocket::readyRead, this, &QWebGLHttpServer::readData);
+
+    auto idleTimer = new QTimer(socket);
+    idleTimer->setObjectName(QStringLiteral("keepAlive"));
+    idleTimer->setSingleShot(true);
+    idleTimer->setInterval(keepAliveTimeout);
+    connect(idleTimer, &QTimer::timeout, socket, &QTcpSocket::disconnectFromHost);
+    connect(socket, &QTcpSocket::readyRead, idleTimer, QOverload<>::of(&QTimer::start));
+    idleTimer->start();
 }
 
 void QWebGLHttpServer::clientDisconnected()
@@ -168,80 +465,121 @@ void QWebGLHttpServer::readData()
     Q_D(QWebGLHttpServer);
     auto socket = qobject_cast<QTcpSocket *>(sender());
     if (!d->clients.contains(socket))
-        d->clients[socket].port = d->server.serverPort();
+        d->clients[socket].request.port = d->server.serverPort();
+
+    auto connection = &d->clients[socket];
+    do {
+        auto request = &connection->request;
+        // The head is peeked and only consumed once answered, a WebSocket upgrade is handed over
+        // with the handshake still unread. Peeking one byte past the limit tells it apart. The
+        // buffer of the connection is reused, the parser resumes where it stopped.
+        const int size = int(qMin(socket->bytesAvailable(), qint64(maxHeaderSize()) + 1));
+        request->buffer.resize(size);
+        socket->peek(request->buffer.data(), size);
+        if (Q_UNLIKELY(!request->parse())) {
+            socket->disconnectFromHost();
+            d->clients.remove(socket);
+            return;
+        }
+        if (request->state != HttpRequest::State::ReadingBody) {
+            if (Q_UNLIKELY(request->buffer.size() > maxHeaderSize())) {
+                qCWarning(lc, "QWebGLHttpServer::readData: Request header larger than %d bytes",
+                          maxHeaderSize());
+                socket->write(QByteArrayLiteral("HTTP/1.1 431 Request Header Fields Too Large\r\n"
+                                                "Content-Length: 0\r\n"
+                                                "Connection: close\r\n\r\n"));
+                socket->disconnectFromHost();
+                d->clients.remove(socket);
+            }
+            return;
+        }
 
-    auto request = &d->clients[socket];
-    bool error = false;
+        if (QWebGLWebSocketServer::isSinglePort()
+                && request->header("upgrade").toLower() == "websocket") {
+            d->clients.remove(socket);
+            upgradeClient(socket);
+            return;
+        }
 
-    request->byteSize += socket->bytesAvailable();
-    if (Q_UNLIKELY(request->byteSize > 2048)) {
-        socket->write(QByteArrayLiteral("HTTP 413 – Request entity too large\r\n"));
-        socket->disconnectFromHost();
-        d->clients.remove(socket);
-        return;
-    }
+        socket->skip(request->parsed);
+        const bool keepAlive = request->isKeepAlive()
+                && ++connection->answered < maxRequestsPerConnection;
+        if (!answerClient(socket, *request, keepAlive)) {
+            d->clients.remove(socket);
+            return;
+        }
+        // Pipelined requests follow the head of the answered one
+        const auto port = request->port;
+        auto buffer = std::move(request->buffer);
+        *request = HttpRequest();
+        request->port = port;
+        request->buffer = std::move(buffer);
+    } while (socket->bytesAvailable());
+}
 
-    if (Q_LIKELY(request->state == HttpRequest::State::ReadingMethod))
-        if (Q_UNLIKELY(error = !request->readMethod(socket)))
-            qCWarning(lc, "QWebGLHttpServer::readData: Invalid Method");
-
-    if (Q_LIKELY(!error && request->state == HttpRequest::State::ReadingUrl))
-        if (Q_UNLIKELY(error = !request->readUrl(socket)))
-            qCWarning(lc, "QWebGLHttpServer::readData: Invalid URL");
-
-    if (Q_LIKELY(!error && request->state == HttpRequest::State::ReadingStatus))
-        if (Q_UNLIKELY(error = !request->readStatus(socket)))
-            qCWarning(lc, "QWebGLHttpServer::readData: Invalid Status");
-
-    if (Q_LIKELY(!error && request->state == HttpRequest::State::ReadingHeader))
-        if (Q_UNLIKELY(error = !request->readHeader(socket)))
-            qCWarning(lc, "QWebGLHttpServer::readData: Invalid Header");
-
-    if (error) {
-        socket->disconnectFromHost();
-        d->clients.remove(socket);
-    } else if (!request->url.isEmpty()) {
-        Q_ASSERT(request->state != HttpRequest::State::ReadingUrl);
-        answerClient(socket, request->url);
-        d->clients.remove(socket);
-    }
+void QWebGLHttpServer::upgradeClient(QTcpSocket *socket)
+{
+    Q_D(QWebGLHttpServer);
+    qCDebug(lc, "Upgrading %p to a WebSocket connection", socket);
+    socket->disconnect(this);
+    delete socket->findChild<QTimer *>(QStringLiteral("keepAlive"));
+    socket->setParent(nullptr);
+    socket->moveToThread(d->webSocketServer->thread());
+    QPointer<QWebGLWebSocketServer> webSocketServer = d->webSocketServer;
+    QMetaObject::invokeMethod(webSocketServer, [webSocketServer, socket]()
+    {
+        webSocketServer->handleConnection(socket);
+    }, Qt::QueuedConnection);
 }
 
-void QWebGLHttpServer::answerClient(QTcpSocket *socket, const QUrl &url)
+bool QWebGLHttpServer::answerClient(QTcpSocket *socket, const HttpRequest &request,
+                                    bool keepAlive)
 {
     Q_D(QWebGLHttpServer);
     bool disconnect = true;
-    const auto path = url.path();
+    QIODevice *stream = nullptr;
+    bool chunked = false;
+    const auto path = request.url.path();
 
     qCDebug(lc, "%s requested: %s",
            qPrintable(socket->localAddress().toString()), qPrintable(path));
 
+    const auto connection = keepAlive ? QByteArrayLiteral("Connection: keep-alive\r\n\r\n")
+                                      : QByteArrayLiteral("Connection: close\r\n\r\n");
     QByteArray answer = QByteArrayLiteral("HTTP/1.1 404 Not Found\r\n"
                                           "Content-Type: text/html\r\n"
-                                          "Content-Length: 136\r\n\r\n"
-                                          "<html>"
+                                          "Content-Length: 136\r\n") + connection +
+                        QByteArrayLiteral("<html>"
                                           "<head><title>404 Not Found</title></head>"
                                           "<body bgcolor=\"white\">"
                                           "<center><h1>404 Not Found</h1></center>"
                                           "</body>"
                                           "</html>");
-    const auto addData = [&answer](const QByteArray &contentType, const QByteArray &data)
+    const auto addData = [&answer, &connection](const QByteArray &contentType,
+                                                const QByteArray &data)
     {
-        answer = QByteArrayLiteral("HTTP/1.0 200 OK \r\n");
-        QByteArray ret;
+        answer = QByteArrayLiteral("HTTP/1.1 200 OK\r\n");
         const auto dataSize = QString::number(data.size()).toUtf8();
         answer += QByteArrayLiteral("Content-Type: ") + contentType + QByteArrayLiteral("\r\n") +
-                  QByteArrayLiteral("Content-Length: ") + dataSize + QByteArrayLiteral("\r\n\r\n") +
-                  data;
+                  QByteArrayLiteral("Content-Length: ") + dataSize + QByteArrayLiteral("\r\n") +
+                  connection + data;
     };
 
-    if (path == QLatin1String("/")) {
-        QFile file(QStringLiteral(":/webgl/index.html"));
-        Q_ASSERT(file.exists());
-        file.open(QIODevice::ReadOnly | QIODevice::Text);
-        Q_ASSERT(file.isOpen());
-        auto data = file.readAll();
-        addData(QByteArrayLiteral("text/html; charset=\"utf-8\""), data);
+    if (const auto asset = d->asset(path)) {
+        const auto headers = QByteArrayLiteral("ETag: ") + asset->etag +
+                QByteArrayLiteral("\r\nCache-Control: ") + asset->cacheControl +
+                QByteArrayLiteral("\r\nVary: Accept-Encoding\r\n");
+        if (request.header("if-none-match").contains(asset->etag)) {
+            answer = QByteArrayLiteral("HTTP/1.1 304 Not Modified\r\n") + headers + connection;
+        } else if (!asset->gzipData.isEmpty()
+                   && request.header("accept-encoding").contains("gzip")) {
+            addData(asset->contentType, asset->gzipData);
+            answer.insert(answer.indexOf("\r\n") + 2,
+                          headers + QByteArrayLiteral("Content-Encoding: gzip\r\n"));
+        } else {
+            addData(asset->contentType, asset->data);
+            answer.insert(answer.indexOf("\r\n") + 2, headers);
+        }
     } else if (path == QStringLiteral("/clipboard")) {
 #ifndef QT_NO_CLIPBOARD
         auto data = qGuiApp->clipboard()->text().toUtf8();
@@ -249,169 +587,152 @@ void QWebGLHttpServer::answerClient(QTcpSocket *socket, const QUrl &url)
 #else
         qCWarning(lc, "Qt was built without clipboard support");
 #endif
-    } else if (path == QStringLiteral("/webqt.js")) {
-        QFile file(QStringLiteral(":/webgl/webqt.jsx"));
-        Q_ASSERT(file.exists());
-        file.open(QIODevice::ReadOnly | QIODevice::Text);
-        Q_ASSERT(file.isOpen());
-        const auto host = url.host().toUtf8();
-        const auto port = QString::number(d->webSocketServer->port()).toUtf8();
-        QByteArray data = "var host = \"" + host + "\";\r\nvar port = " + port + ";\r\n";
-        data += file.readAll();
-        addData(QByteArrayLiteral("application/javascript"), data);
-    } else if (path == QStringLiteral("/favicon.ico")) {
-        QFile file(QStringLiteral(":/webgl/favicon.ico"));
-        Q_ASSERT(file.exists());
-        file.open(QIODevice::ReadOnly);
-        Q_ASSERT(file.isOpen());
-        auto data = file.readAll();
-        addData(QByteArrayLiteral("image/x-icon"), data);
-    } else if (path == QStringLiteral("/favicon.png")) {
-        QBuffer buffer;
-        qGuiApp->windowIcon().pixmap(16, 16).save(&buffer, "png");
-        addData(QByteArrayLiteral("image/x-icon"), buffer.data());
     } else if (auto device = d->customRequestDevices.value(path)) {
-        answer = QByteArrayLiteral("HTTP/1.0 200 OK \r\n"
+        // HTTP/1.0 clients get the stream without framing, its end closes the connection
+        chunked = request.version.first == 1 && request.version.second >= 1;
+        answer = QByteArrayLiteral("HTTP/1.1 200 OK\r\n"
                                    "Content-Type: text/plain; charset=\"utf-8\"\r\n"
-                                   "Connection: Keep.Alive\r\n\r\n") +
-                device->readAll();
-        auto timer = new QTimer(device);
-        timer->setSingleShot(false);
-        connect(timer, &QTimer::timeout, [device, socket]()
-        {
-            if (device->bytesAvailable())
-                socket->write(device->readAll());
-        });
-        timer->start(1000);
+                                   "Cache-Control: no-cache\r\n") +
+                (chunked ? QByteArrayLiteral("Transfer-Encoding: chunked\r\n")
+                         : QByteArrayLiteral("")) +
+                QByteArrayLiteral("Connection: close\r\n\r\n");
+        stream = device;
         disconnect = false;
+        // The response lasts as long as the device, the connection serves no further requests
+        delete socket->findChild<QTimer *>(QStringLiteral("keepAlive"));
+        QObject::disconnect(socket, &QTcpSocket::readyRead, this, &QWebGLHttpServer::readData);
     }
     socket->write(answer);
-    if (disconnect)
-        socket->disconnectFromHost();
+    if (stream)
+        streamDevice(socket, stream, chunked);
+    if (!disconnect)
+        return false;
+    if (keepAlive)
+        return true;
+    socket->disconnectFromHost();
+    return false;
 }
 
-bool HttpRequest::readMethod(QTcpSocket *socket)
+bool HttpRequest::parse()
 {
-    bool finished = false;
-    while (socket->bytesAvailable() && !finished) {
-        const auto c = socket->read(1).at(0);
-        if (std::isupper(c) && fragment.size() < 6)
-            fragment += c;
-        else
-            finished = true;
-    }
-    if (finished) {
-        if (fragment == "HEAD")
-            method = Method::Head;
-        else if (fragment == "GET")
-            method = Method::Get;
-        else if (fragment == "PUT")
-            method = Method::Put;
-        else if (fragment == "POST")
-            method = Method::Post;
-        else if (fragment == "DELETE")
-            method = Method::Delete;
-        else
-            qCWarning(lc, "QWebGLHttpServer::HttpRequest::readMethod: Invalid operation %s",
-                     fragment.data());
-
-        state = State::ReadingUrl;
-        fragment.clear();
-
-        return method != Method::Unknown;
+    const char *data = buffer.constData();
+    const char *end = data + buffer.size();
+    while (state == State::ReadingRequestLine || state == State::ReadingHeader) {
+        const char *begin = data + parsed;
+        const char *from = data + qMax(parsed, scanned);
+        const auto newline = static_cast<const char *>(std::memchr(from, '\n', end - from));
+        if (!newline) {
+            scanned = buffer.size();
+            return true; // Wait for the rest of the line
+        }
+        parsed = int(newline + 1 - data);
+        const char *lineEnd = newline > begin && newline[-1] == '\r' ? newline - 1 : newline;
+        if (state == State::ReadingRequestLine) {
+            if (lineEnd == begin)
+                continue; // Empty lines before the request line are ignored
+            if (!parseRequestLine(begin, lineEnd))
+                return false;
+            state = State::ReadingHeader;
+        } else if (lineEnd == begin) {
+            state = State::ReadingBody;
+        } else if (!parseHeader(begin, lineEnd)) {
+            qCWarning(lc, "QWebGLHttpServer::HttpRequest::parseHeader: Invalid header");
+            return false;
+        }
     }
     return true;
 }
 
-bool HttpRequest::readUrl(QTcpSocket *socket)
+QByteArray HttpRequest::header(const QByteArray &name) const
 {
-    bool finished = false;
-    while (socket->bytesAvailable() && !finished) {
-        char c;
-        if (!socket->getChar(&c))
-            return false;
-        if (std::isspace(c))
-            finished = true;
-        else
-            fragment += c;
+    for (auto it = headers.cbegin(), end = headers.cend(); it != end; ++it) {
+        if (qstricmp(it.key().constData(), name.constData()) == 0)
+            return it.value();
     }
-    if (finished) {
-        if (!fragment.startsWith("/")) {
-            qCWarning(lc, "QWebGLHttpServer::HttpRequest::readUrl: Invalid URL path %s",
-                     fragment.constData());
-            return false;
-        }
-        url.setUrl(QStringLiteral("http://localhost:") + QString::number(port) +
-                   QString::fromUtf8(fragment));
-        state = State::ReadingStatus;
-        if (!url.isValid()) {
-            qCWarning(lc, "QWebGLHttpServer::HttpRequest::readUrl: Invalid URL %s",
-                     fragment.constData());
-            return false;
-        }
-        fragment.clear();
-        return true;
+    return QByteArray();
+}
+
+bool HttpRequest::isKeepAlive() const
+{
+    // Request bodies are not read, their bytes would be taken for the next request
+    const auto contentLength = header("content-length");
+    bool ok = true;
+    if ((!contentLength.isEmpty() && (contentLength.toLongLong(&ok) != 0 || !ok))
+            || !header("transfer-encoding").isEmpty()) {
+        return false;
     }
-    return true;
+    const auto connection = header("connection").toLower();
+    if (version.first == 1 && version.second >= 1)
+        return !connection.contains("close");
+    return connection.contains("keep-alive");
 }
 
-bool HttpRequest::readStatus(QTcpSocket *socket)
+bool HttpRequest::parseRequestLine(const char *begin, const char *end)
 {
-    bool finished = false;
-    while (socket->bytesAvailable() && !finished) {
-        fragment += socket->read(1);
-        if (fragment.endsWith("\r\n")) {
-            finished = true;
-            fragment.chop(2);
-        }
+    const auto methodEnd = static_cast<const char *>(std::memchr(begin, ' ', end - begin));
+    if (!methodEnd)
+        return false;
+    const auto methodName = QByteArray::fromRawData(begin, int(methodEnd - begin));
+    if (methodName == "HEAD")
+        method = Method::Head;
+    else if (methodName == "GET")
+        method = Method::Get;
+    else if (methodName == "PUT")
+        method = Method::Put;
+    else if (methodName == "POST")
+        method = Method::Post;
+    else if (methodName == "DELETE")
+        method = Method::Delete;
+    if (method == Method::Unknown) {
+        qCWarning(lc, "QWebGLHttpServer::HttpRequest::parseRequestLine: Invalid operation %s",
+                  methodName.left(8).constData());
+        return false;
     }
-    if (finished) {
-        if (!std::isdigit(fragment.at(fragment.size() - 3)) ||
-                !std::isdigit(fragment.at(fragment.size() - 1))) {
-            qCWarning(lc, "QWebGLHttpServer::HttpRequest::::readStatus: Invalid version");
-            return false;
-        }
-        version = qMakePair(fragment.at(fragment.size() - 3) - '0',
-                            fragment.at(fragment.size() - 1) - '0');
-        state = State::ReadingHeader;
-        fragment.clear();
+
+    const char *target = methodEnd + 1;
+    const auto targetEnd = static_cast<const char *>(std::memchr(target, ' ', end - target));
+    if (!targetEnd || target == targetEnd || *target != '/') {
+        qCWarning(lc, "QWebGLHttpServer::HttpRequest::parseRequestLine: Invalid URL path");
+        return false;
     }
+    url.setUrl(QStringLiteral("http://localhost:") + QString::number(port) +
+               QString::fromUtf8(target, int(targetEnd - target)));
+    if (!url.isValid()) {
+        qCWarning(lc, "QWebGLHttpServer::HttpRequest::parseRequestLine: Invalid URL");
+        return false;
+    }
+
+    const char *versionBegin = targetEnd + 1;
+    if (end - versionBegin != 8 || std::memcmp(versionBegin, "HTTP/", 5) != 0
+            || !std::isdigit(uchar(versionBegin[5])) || versionBegin[6] != '.'
+            || !std::isdigit(uchar(versionBegin[7]))) {
+        qCWarning(lc, "QWebGLHttpServer::HttpRequest::parseRequestLine: Invalid version");
+        return false;
+    }
+    version = qMakePair(quint8(versionBegin[5] - '0'), quint8(versionBegin[7] - '0'));
     return true;
 }
 
-bool HttpRequest::readHeader(QTcpSocket *socket)
+bool HttpRequest::parseHeader(const char *begin, const char *end)
 {
-    while (socket->bytesAvailable()) {
-        fragment += socket->read(1);
-        if (fragment.endsWith("\r\n")) {
-            if (fragment == "\r\n") {
-                state = State::ReadingBody;
-                fragment.clear();
-                return true;
-            } else {
-                fragment.chop(2);
-                const int index = fragment.indexOf(':');
-                if (index == -1)
-                    return false;
-
-                const QByteArray key = fragment.mid(0, index).trimmed();
-                const QByteArray value = fragment.mid(index + 1).trimmed();
-                headers.insert(key, value);
-                if (QStringLiteral("host").compare(key, Qt::CaseInsensitive) == 0) {
-                    auto parts = value.split(':');
-                    if (parts.size() == 1) {
-                        url.setHost(parts.first());
-                        url.setPort(80);
-                    } else {
-                        url.setHost(parts.first());
-                        url.setPort(std::strtoul(parts.at(1).constData(), nullptr, 10));
-                    }
-                }
-                fragment.clear();
-            }
+    const auto colon = static_cast<const char *>(std::memchr(begin, ':', end - begin));
+    if (!colon)
+        return false;
+
+    const QByteArray key = QByteArray(begin, int(colon - begin)).trimmed();
+    const QByteArray value = QByteArray(colon + 1, int(end - colon - 1)).trimmed();
+    headers.insert(key, value);
+    if (QStringLiteral("host").compare(key, Qt::CaseInsensitive) == 0) {
+        auto parts = value.split(':');
+        if (parts.size() == 1) {
+            url.setHost(parts.first());
+            url.setPort(80);
+        } else {
+            url.setHost(parts.first());
+            url.setPort(std::strtoul(parts.at(1).constData(), nullptr, 10));
         }
     }
-    return false;
+    return true;
 }
 
 QT_END_NAMESPACE
@@ -42,6 +42,7 @@ class QString;
 class QUrl;
 class QWebGLWebSocketServer;
 class QWebGLHttpServerPrivate;
+struct HttpRequest;
 
 class QWebGLHttpServer : public QObject
 {
@@ -52,6 +53,7 @@ public:
     ~QWebGLHttpServer() override;
 
     bool listen(const QHostAddress &address = QHostAddress::Any, quint16 port = 0);
+    bool listen(const QString &name); // A Unix domain socket
     bool isListening() const;
     quint16 serverPort() const;
 
@@ -64,9 +66,13 @@ private slots:
     void clientConnected();
     void clientDisconnected();
     void readData();
-    void answerClient(QTcpSocket *socket, const QUrl &urls);
 
 private:
+    friend class LocalServer;
+    void acceptClient(QTcpSocket *socket);
+    bool answerClient(QTcpSocket *socket, const HttpRequest &request, bool keepAlive);
+    void upgradeClient(QTcpSocket *socket);
+
     Q_DISABLE_COPY(QWebGLHttpServer)
     Q_DECLARE_PRIVATE(QWebGLHttpServer)
     QScopedPointer<QWebGLHttpServerPrivate> d_ptr;
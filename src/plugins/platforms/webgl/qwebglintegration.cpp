@@ -36,7 +36,12 @@
 #include "qwebglhttpserver.h"
 #include "qwebglwebsocketserver.h"
 #include "qwebglplatformservices.h"
+#include "qwebglresourcetracker.h"
+#include "qwebglsessionmanager.h"
+#include "qwebgltrace.h"
 
+#include <QtCore/qdeadlinetimer.h>
+#include <QtCore/qendian.h>
 #include <QtCore/qjsonarray.h>
 #include <QtCore/qjsondocument.h>
 #include <QtCore/qjsonobject.h>
@@ -60,6 +65,10 @@
 #include <QtQuick/qquickwindow.h>
 #endif
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 QT_BEGIN_NAMESPACE
 
 Q_LOGGING_CATEGORY(lcWebGL, "qt.qpa.webgl")
@@ -113,9 +122,31 @@ void QWebGLIntegration::initialize()
     d->screen = new QWebGLScreen;
     QWindowSystemInterface::handleScreenAdded(d->screen, true);
 
+    if (const int poolSize = QWebGLSessionManager::poolSize()) {
+        // The public ports belong to the session manager, each browser gets a worker process
+        d->sessionManager = new QWebGLSessionManager(poolSize, this);
+        if (!d->sessionManager->listen(QHostAddress::Any, d->httpPort, d->wssPort)) {
+            qFatal("QWebGLIntegration::initialize: Failed to initialize: %s",
+                   qPrintable(d->sessionManager->errorString()));
+        }
+        d->httpPort = 0;
+        d->wssPort = 0;
+    } else if (QWebGLSessionManager::isWorker()) {
+        d->httpPort = 0;
+        d->wssPort = 0;
+    }
+
     d->webSocketServer = new QWebGLWebSocketServer(d->wssPort);
     d->httpServer = new QWebGLHttpServer(d->webSocketServer, this);
-    bool ok = d->httpServer->listen(QHostAddress::Any, d->httpPort);
+    const auto localSocket = qEnvironmentVariable("QT_WEBGL_LOCAL_SOCKET");
+    bool ok = false;
+    if (!localSocket.isEmpty() && !d->sessionManager) {
+        ok = d->httpServer->listen(localSocket);
+    } else {
+        ok = d->httpServer->listen(d->sessionManager || QWebGLSessionManager::isWorker()
+                                   ? QHostAddress(QHostAddress::LocalHost)
+                                   : QHostAddress(QHostAddress::Any), d->httpPort);
+    }
     if (!ok) {
         qFatal("QWebGLIntegration::initialize: Failed to initialize: %s",
                qPrintable(d->httpServer->errorString()));
@@ -129,6 +160,11 @@ void QWebGLIntegration::initialize()
     QMutexLocker lock(d->webSocketServer->mutex());
     d->webSocketServerThread->start();
     d->webSocketServer->waitCondition()->wait(d->webSocketServer->mutex());
+    if (QWebGLSessionManager::isWorker())
+        QWebGLSessionManager::registerWorker(d->httpServer->serverPort(),
+                                             QWebGLWebSocketServer::isSinglePort()
+                                             ? d->httpServer->serverPort()
+                                             : d->webSocketServer->port(), this);
 
     qGuiApp->setQuitOnLastWindowClosed(false);
 }
@@ -147,6 +183,9 @@ void QWebGLIntegration::destroy()
     d->webSocketServerThread->quit();
     d->webSocketServerThread->wait();
     delete d->webSocketServerThread;
+
+    if (QWebGLTrace::isEnabled())
+        QWebGLTrace::write(QString::fromLocal8Bit(qgetenv("QT_WEBGL_TRACE")));
 }
 
 QAbstractEventDispatcher *QWebGLIntegration::createEventDispatcher() const
@@ -214,7 +253,7 @@ QPlatformWindow *QWebGLIntegration::createPlatformWindow(QWindow *window) const
     QWindowSystemInterface::flushWindowSystemEvents();
 
     QWebGLWindow *platformWindow = nullptr;
-    QWebSocket *socket = nullptr;
+    QVector<QWebSocket *> sockets;
     auto winId = WId(-1);
     {
         QMutexLocker locker(&d->clients.mutex);
@@ -228,26 +267,39 @@ QPlatformWindow *QWebGLIntegration::createPlatformWindow(QWindow *window) const
         window->setScreen(client->platformScreen->screen());
         client->platformWindows.append(new QWebGLWindow(window));
         platformWindow = client->platformWindows.last();
-        socket = client->socket;
+        // Viewers joining from now on get the canvas with the others, see addViewer
+        sockets = QVector<QWebSocket *> { client->socket } + client->viewers;
         platformWindow->create();
         platformWindow->requestActivateWindow();
         winId = platformWindow->winId();
+        if (!client->defaultContextParameters.isEmpty()) {
+            // The parameters were probed on another canvas, only the viewport differs
+            auto defaults = client->defaultContextParameters;
+            const auto geometry = platformWindow->geometry();
+            defaults.insert(GL_VIEWPORT, QVariantList { 0, 0, geometry.width(),
+                                                        geometry.height() });
+            platformWindow->setDefaults(defaults);
+        }
     }
 
-    const QVariantMap values {
-        { "x", platformWindow->geometry().x() },
-        { "y", platformWindow->geometry().y() },
-        { "width", platformWindow->geometry().width() },
-        { "height", platformWindow->geometry().height() },
-        { "winId", winId },
-        { "title", qApp->applicationDisplayName() }
-    };
-    d->sendMessage(socket, QWebGLWebSocketServer::MessageType::CreateCanvas, values);
+    for (auto socket : qAsConst(sockets))
+        d->sendCreateCanvas(socket, platformWindow);
 
     QObject::connect(window, &QWindow::windowTitleChanged, [=](const QString &title)
     {
-        const QVariantMap values{{ "title", title }, { "winId", winId }};
-        d->sendMessage(socket, QWebGLWebSocketServer::MessageType::ChangeTitle, values);
+        // The socket of the window changes when a detached client is resumed
+        QMutexLocker locker(&d->clients.mutex);
+        for (const auto &client : qAsConst(d->clients.list)) {
+            if (client.socket && client.platformWindows.contains(platformWindow)) {
+                const QVariantMap values{{ "title", title }, { "winId", winId }};
+                d->sendMessage(client.socket, QWebGLWebSocketServer::MessageType::ChangeTitle,
+                               values);
+                for (auto viewer : client.viewers) {
+                    d->sendMessage(viewer, QWebGLWebSocketServer::MessageType::ChangeTitle,
+                                   values);
+                }
+            }
+        }
     });
     qCDebug(lcWebGL, "Created platform window %p for: %p", platformWindow, window);
     return platformWindow;
@@ -288,6 +340,26 @@ QPlatformNativeInterface *QWebGLIntegration::nativeInterface() const
     return const_cast<QWebGLIntegration *>(this);
 }
 
+QPlatformNativeInterface::NativeResourceForIntegrationFunction
+QWebGLIntegration::nativeResourceFunctionForIntegration(const QByteArray &resource)
+{
+    const QByteArray lowerCaseResource = resource.toLower();
+    if (lowerCaseResource == "settexturereducedprecision") {
+        return NativeResourceForIntegrationFunction(QWebGLContext::setTextureReducedPrecision);
+    } else if (lowerCaseResource == "readpixelsasync") {
+        return NativeResourceForIntegrationFunction(QWebGLContext::readPixelsAsync);
+    } else if (lowerCaseResource == "optimisticquerymismatches") {
+        return NativeResourceForIntegrationFunction(QWebGLContext::optimisticQueryMismatches);
+    } else if (lowerCaseResource == "latencyhistogram") {
+        return NativeResourceForIntegrationFunction(QWebGLLatencyTracer::latencyHistogram);
+    } else if (lowerCaseResource == "writetrace") {
+        return NativeResourceForIntegrationFunction(QWebGLTrace::write);
+    } else if (lowerCaseResource == "setcustomrequestdevice") {
+        return NativeResourceForIntegrationFunction(setCustomRequestDevice);
+    }
+    return nullptr;
+}
+
 void QWebGLIntegration::openUrl(const QUrl &url)
 {
     Q_D(QWebGLIntegration);
@@ -301,6 +373,12 @@ void QWebGLIntegration::openUrl(const QUrl &url)
     }
 }
 
+void QWebGLIntegration::setCustomRequestDevice(const QString &path, QIODevice *device)
+{
+    // The HTTP server lives in the GUI thread, like the devices it streams
+    instance()->d_func()->httpServer->setCustomRequestDevice(path, device);
+}
+
 QWebGLIntegrationPrivate::ClientData *QWebGLIntegrationPrivate::findClientData(
         const QWebSocket *socket)
 {
@@ -341,12 +419,51 @@ void QWebGLIntegrationPrivate::clientConnected(QWebSocket *socket,
                                                const int width,
                                                const int height,
                                                const double physicalWidth,
-                                               const double physicalHeight)
+                                               const double physicalHeight,
+                                               const bool supportsImageBitmap,
+                                               const bool supportsDecompressionStream,
+                                               const bool supportsFloatTextures,
+                                               const bool supportsHalfFloatTextures,
+                                               const QMap<unsigned int, QVariant> &defaults)
 {
     qCDebug(lcWebGL, "%p, Size: %dx%d. Physical Size: %fx%f",
             socket, width, height, physicalWidth, physicalHeight);
+    {
+        QMutexLocker locker(&clients.mutex);
+        const auto it = std::find_if(clients.list.begin(), clients.list.end(),
+                                     [](const ClientData &item) { return !item.socket; });
+        if (it != clients.list.end()) {
+            // A client was detached when its socket closed, resume it on the new socket
+            it->socket = socket;
+            it->connectedSocket.storeRelease(socket);
+            it->supportsImageBitmap = supportsImageBitmap;
+            it->supportsDecompressionStream = supportsDecompressionStream;
+            it->supportsFloatTextures = supportsFloatTextures;
+            it->supportsHalfFloatTextures = supportsHalfFloatTextures;
+            it->defaultContextParameters = defaults;
+            it->platformScreen->setGeometry(width, height, physicalWidth, physicalHeight);
+            resumeClient(*it);
+            return;
+        }
+        if (isBroadcastEnabled()) {
+            const auto primary = std::find_if(clients.list.begin(), clients.list.end(),
+                                              [](const ClientData &item) {
+                return item.socket && !item.platformWindows.isEmpty();
+            });
+            if (primary != clients.list.end()) {
+                addViewer(*primary, socket);
+                return;
+            }
+        }
+    }
     QWebGLIntegrationPrivate::ClientData client;
     client.socket = socket;
+    client.connectedSocket.storeRelease(socket);
+    client.supportsImageBitmap = supportsImageBitmap;
+    client.supportsDecompressionStream = supportsDecompressionStream;
+    client.supportsFloatTextures = supportsFloatTextures;
+    client.supportsHalfFloatTextures = supportsHalfFloatTextures;
+    client.defaultContextParameters = defaults;
     client.platformScreen = new QWebGLScreen(QSize(width, height),
                                              QSizeF(physicalWidth, physicalHeight));
     clients.mutex.lock();
@@ -359,29 +476,125 @@ void QWebGLIntegrationPrivate::clientConnected(QWebSocket *socket,
 void QWebGLIntegrationPrivate::clientDisconnected(QWebSocket *socket)
 {
     qCDebug(lcWebGL, "%p", socket);
+    if (QWebGLLatencyTracer::isEnabled())
+        latencyTracer.clientDisconnected(socket);
     const auto predicate = [=](const QWebGLIntegrationPrivate::ClientData &item)
     {
         return socket == item.socket;
     };
 
     clients.mutex.lock();
+    for (auto &client : clients.list) {
+        if (client.viewers.removeOne(socket)) {
+            qCDebug(lcWebGL, "Viewer %p left", socket);
+            clients.mutex.unlock();
+            return;
+        }
+    }
     auto it = std::find_if(clients.list.begin(), clients.list.end(), predicate);
+    // Viewers do not answer queries, the creations the primary client left unanswered are lost
+    if (it != clients.list.end())
+        webSocketServer->cancelCreations();
+    if (it != clients.list.end() && !it->viewers.isEmpty()) {
+        // The oldest viewer takes over, it already renders the session
+        it->socket = it->viewers.takeFirst();
+        it->connectedSocket.storeRelease(it->socket);
+        qCDebug(lcWebGL, "Viewer %p replaces %p", it->socket, socket);
+        clients.mutex.unlock();
+        cancelResponses(socket);
+        return;
+    }
+    if (it != clients.list.end() && QWebGLResourceTracker::isEnabled()
+            && !it->platformWindows.isEmpty()) {
+        // Keep the windows and their GL resources for the next client, see clientConnected
+        qCDebug(lcWebGL, "Detaching %d windows from %p", it->platformWindows.size(), socket);
+        it->socket = nullptr;
+        it->connectedSocket.storeRelease(nullptr);
+        for (auto platformWindow : it->platformWindows)
+            QWindowSystemInterface::handleExposeEvent(platformWindow->window(), QRegion());
+        clients.mutex.unlock();
+        cancelResponses(socket);
+        return;
+    }
     if (it != clients.list.end()) {
         for (auto platformWindow : it->platformWindows) {
+            platformWindow->setDefaults({}); // Releases a makeCurrent waiting for the defaults
             auto window = platformWindow->window();
             QTimer::singleShot(0, window, &QWindow::close);
         }
         clients.list.erase(it);
+        // A session worker serves a single browser, the manager replaces it in the pool
+        if (QWebGLSessionManager::isWorker())
+            QMetaObject::invokeMethod(qGuiApp, &QCoreApplication::quit, Qt::QueuedConnection);
     }
     clients.mutex.unlock();
+    cancelResponses(socket);
     connectNextClient();
 }
 
+void QWebGLIntegrationPrivate::resumeClient(const ClientData &clientData)
+{
+    qCDebug(lcWebGL, "Resuming %d windows on %p", clientData.platformWindows.size(),
+            clientData.socket);
+    // Runs in the WebSocket thread: the replay is sent before any queued gl_command
+    for (auto platformWindow : clientData.platformWindows)
+        sendCreateCanvas(clientData.socket, platformWindow);
+    webSocketServer->replayResources(clientData.socket);
+    for (auto platformWindow : clientData.platformWindows) {
+        QWindowSystemInterface::handleExposeEvent(
+                    platformWindow->window(),
+                    QRect(QPoint(0, 0), platformWindow->geometry().size()));
+    }
+}
+
+bool QWebGLIntegrationPrivate::isBroadcastEnabled()
+{
+    static const bool enabled = []() {
+        const auto value = qgetenv("QT_WEBGL_BROADCAST");
+        return !value.isEmpty() && value != "0";
+    }();
+    return enabled;
+}
+
+void QWebGLIntegrationPrivate::addViewer(ClientData &clientData, QWebSocket *socket)
+{
+    // Runs in the WebSocket thread, like every reader of the viewers
+    qCDebug(lcWebGL, "%p joins the session of %p as a viewer", socket, clientData.socket);
+    for (auto platformWindow : clientData.platformWindows)
+        sendCreateCanvas(socket, platformWindow);
+    webSocketServer->replayResources(socket);
+    clientData.viewers.append(socket);
+}
+
+bool QWebGLIntegrationPrivate::isViewer(const QWebSocket *socket)
+{
+    QMutexLocker locker(&clients.mutex);
+    for (const auto &client : qAsConst(clients.list)) {
+        if (client.viewers.contains(const_cast<QWebSocket *>(socket)))
+            return true;
+    }
+    return false;
+}
+
+void QWebGLIntegrationPrivate::sendCreateCanvas(QWebSocket *socket,
+                                                QWebGLWindow *platformWindow) const
+{
+    const QVariantMap values {
+        { "x", platformWindow->geometry().x() },
+        { "y", platformWindow->geometry().y() },
+        { "width", platformWindow->geometry().width() },
+        { "height", platformWindow->geometry().height() },
+        { "winId", platformWindow->winId() },
+        { "title", qApp->applicationDisplayName() }
+    };
+    sendMessage(socket, QWebGLWebSocketServer::MessageType::CreateCanvas, values);
+}
+
 void QWebGLIntegrationPrivate::connectNextClient()
 {
     static QMutex connecting;
     if (connecting.tryLock()) {
-        QTimer::singleShot(1000, [=]() {
+        QTimer::singleShot(0, [=]() {
             clients.mutex.lock();
             if (!clients.list.isEmpty()) {
                 const auto clientData = clients.list.first();
@@ -426,7 +639,14 @@ void QWebGLIntegrationPrivate::onTextMessageReceived(QWebSocket *socket, const Q
 
     if (type == QStringLiteral("connect"))
         clientConnected(socket, object["width"].toInt(), object["height"].toInt(),
-                          object["physicalWidth"].toDouble(), object["physicalHeight"].toDouble());
+                        object["physicalWidth"].toDouble(), object["physicalHeight"].toDouble(),
+                        object["imageBitmap"].toBool(),
+                        object["decompressionStream"].toBool(),
+                        object["floatTextures"].toBool(),
+                        object["halfFloatTextures"].toBool(),
+                        contextParameters(object["defaultContextParameters"].toObject()));
+    else if (isViewer(socket))
+        return; // read-only
     else if (!clientData || clientData->platformWindows.isEmpty())
         qCWarning(lcWebGL, "Message received before connect %s", qPrintable(message));
     else if (type == QStringLiteral("default_context_parameters"))
@@ -445,6 +665,18 @@ void QWebGLIntegrationPrivate::onTextMessageReceived(QWebSocket *socket, const Q
         handleCanvasResize(*clientData, object);
 }
 
+QMap<unsigned int, QVariant> QWebGLIntegrationPrivate::contextParameters(const QJsonObject &object)
+{
+    QMap<unsigned int, QVariant> result;
+    for (auto it = object.constBegin(), end = object.constEnd(); it != end; ++it) {
+        bool ok;
+        const auto pname = it.key().toUInt(&ok);
+        if (ok) // skips "type" and "name"
+            result.insert(pname, it.value().toVariant());
+    }
+    return result;
+}
+
 void QWebGLIntegrationPrivate::handleDefaultContextParameters(const ClientData &clientData,
                                                               const QJsonObject &object)
 {
@@ -452,25 +684,404 @@ void QWebGLIntegrationPrivate::handleDefaultContextParameters(const ClientData &
     Q_ASSERT(winId != -1);
     QWebGLWindow *platformWindow = findWindow(clientData, winId);
     Q_ASSERT(platformWindow);
-    auto data = object.toVariantMap();
-    data.remove("name");
-    data.remove("type");
-    QMap<GLenum, QVariant> result;
-    for (auto it = data.cbegin(), end = data.cend(); it != end; ++it)
-        result.insert(it.key().toInt(), *it);
-    platformWindow->setDefaults(result);
+    platformWindow->setDefaults(contextParameters(object));
 }
 
 void QWebGLIntegrationPrivate::handleGlResponse(const QJsonObject &object)
 {
     qCDebug(lcWebGL, ) << "gl_response message received" << object;
-    QMutexLocker locker(&waitMutex);
-    const auto id = object["id"];
-    const auto value = object["value"].toVariant();
-    Q_ASSERT(pendingResponses.contains(id.toInt()));
-    receivedResponses.insert(id.toInt(), value);
-    pendingResponses.removeOne(id.toInt());
-    waitCondition.wakeAll();
+    handleGlResponse(object["id"].toInt(), object["value"].toVariant());
+}
+
+void QWebGLIntegrationPrivate::handleGlResponse(int id, const QVariant &value)
+{
+    webSocketServer->recordResponse(id, value);
+    PendingResponse pending;
+    {
+        QMutexLocker locker(&pendingResponsesMutex);
+        const auto it = pendingResponses.find(id);
+        if (it == pendingResponses.end()) {
+            qCWarning(lcWebGL, "Unexpected gl_response with id %d", id);
+            return;
+        }
+        pending = std::move(it->second);
+        pendingResponses.erase(it);
+    }
+    if (pending.callback)
+        pending.callback(value);
+    else
+        pending.token->complete(id, value); // Wakes only the thread waiting for this call
+}
+
+void QWebGLIntegrationPrivate::expectResponse(int id, const ClientData &clientData,
+                                              const std::shared_ptr<ResponseToken> &token)
+{
+    {
+        QMutexLocker locker(&pendingResponsesMutex);
+        // The connected socket changes before cancelResponses runs for the previous one, under
+        // the same mutex, so a call registered for a closed socket is completed here and never
+        // waits
+        if (const auto socket = clientData.connectedSocket.loadAcquire()) {
+            auto &pending = pendingResponses[id];
+            pending.socket = socket;
+            pending.token = token;
+            return;
+        }
+    }
+    token->complete(id, QVariant());
+}
+
+void QWebGLIntegrationPrivate::expectResponse(int id, const ClientData &clientData,
+                                              ResponseCallback callback)
+{
+    {
+        QMutexLocker locker(&pendingResponsesMutex);
+        if (const auto socket = clientData.connectedSocket.loadAcquire()) {
+            auto &pending = pendingResponses[id];
+            pending.socket = socket;
+            pending.callback = std::move(callback);
+            return;
+        }
+    }
+    callback(QVariant());
+}
+
+void QWebGLIntegrationPrivate::ResponseToken::reset(int id)
+{
+    QMutexLocker locker(&mutex);
+    this->id = id;
+    ready = false;
+    value = QVariant();
+}
+
+void QWebGLIntegrationPrivate::ResponseToken::complete(int id, const QVariant &value)
+{
+    QMutexLocker locker(&mutex);
+    if (this->id != id) // the thread gave up waiting for this call
+        return;
+    ready = true;
+    this->value = value;
+    condition.wakeOne();
+}
+
+bool QWebGLIntegrationPrivate::ResponseToken::wait(int id, QVariant *value,
+                                                   unsigned long timeout)
+{
+    QMutexLocker locker(&mutex);
+    if (this->id != id)
+        return false;
+    QDeadlineTimer deadline(timeout == ULONG_MAX ? QDeadlineTimer::Forever
+                                                 : QDeadlineTimer(qint64(timeout)));
+    while (!ready) {
+        if (!condition.wait(&mutex, deadline))
+            break;
+    }
+    const bool completed = ready;
+    *value = std::move(this->value);
+    this->id = -1;
+    this->value = QVariant();
+    return completed;
+}
+
+void QWebGLIntegrationPrivate::cancelResponses(QWebSocket *socket)
+{
+    std::vector<ResponseCallback> callbacks;
+    {
+        QMutexLocker locker(&pendingResponsesMutex);
+        for (auto it = pendingResponses.begin(); it != pendingResponses.end();) {
+            if (it->second.socket == socket) {
+                if (it->second.callback)
+                    callbacks.push_back(std::move(it->second.callback));
+                else
+                    it->second.token->complete(it->first, QVariant());
+                it = pendingResponses.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (const auto &callback : callbacks)
+        callback(QVariant());
+}
+
+namespace {
+
+// Reads the values of binary messages: big endian integers, tagged values like the ones of the
+// gl_command messages, with 32 bit element counts for arrays ('a') and maps ('m')
+class BinaryMessageReader
+{
+public:
+    explicit BinaryMessageReader(const QByteArray &data) :
+        cursor(data.constData()), end(data.constData() + data.size())
+    {}
+
+    bool isValid() const { return valid; }
+    void invalidate() { valid = false; }
+    bool atEnd() const { return cursor == end; }
+
+    template<typename T>
+    T read()
+    {
+        if (end - cursor < qsizetype(sizeof(T))) {
+            valid = false;
+            return T();
+        }
+        const T value = qFromBigEndian<T>(cursor);
+        cursor += sizeof(T);
+        return value;
+    }
+
+    float readFloat() { return fromBits<float>(read<quint32>()); }
+    double readDouble() { return fromBits<double>(read<quint64>()); }
+
+    QByteArray readBytes()
+    {
+        const auto size = read<quint32>();
+        if (!valid || quint32(end - cursor) < size) {
+            valid = false;
+            return QByteArray();
+        }
+        QByteArray result(cursor, size);
+        cursor += size;
+        return result;
+    }
+
+    QVariant readValue(int depth = 0)
+    {
+        if (depth > maxDepth) {
+            valid = false;
+            return QVariant();
+        }
+        switch (read<quint8>()) {
+        case 'n': return QVariant();
+        case 'b': return bool(read<quint8>());
+        case 'i': return read<qint32>();
+        case 'u': return read<quint32>();
+        case 'd': return readDouble();
+        case 's': return QString::fromUtf8(readBytes());
+        case 'x': return readBytes();
+        case 'a': {
+            const auto count = read<quint32>();
+            QVariantList list;
+            for (quint32 i = 0; valid && i < count; ++i)
+                list.append(readValue(depth + 1));
+            return list;
+        }
+        case 'm': {
+            const auto count = read<quint32>();
+            QVariantMap map;
+            for (quint32 i = 0; valid && i < count; ++i) {
+                const auto key = QString::fromUtf8(readBytes());
+                map.insert(key, readValue(depth + 1));
+            }
+            return map;
+        }
+        default:
+            valid = false;
+            return QVariant();
+        }
+    }
+
+private:
+    template<typename T, typename Bits>
+    static T fromBits(Bits bits)
+    {
+        Q_STATIC_ASSERT(sizeof(T) == sizeof(Bits));
+        T value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    static const int maxDepth = 16;
+    const char *cursor;
+    const char *end;
+    bool valid = true;
+};
+
+QPointF readPoint(BinaryMessageReader &reader)
+{
+    const auto x = reader.readFloat();
+    const auto y = reader.readFloat();
+    return QPointF(x, y);
+}
+
+}
+
+void QWebGLIntegrationPrivate::onBinaryMessageReceived(QWebSocket *socket,
+                                                       const QByteArray &message)
+{
+    if (isViewer(socket)) // read-only, the primary client answers the queries
+        return;
+    BinaryMessageReader reader(message);
+    const auto type = BinaryMessageType(reader.read<quint8>());
+    // The input records are read completely before being handled
+    const auto isValidInput = [&]()
+    {
+        if (!reader.isValid() || !reader.atEnd()) {
+            qCWarning(lcWebGL, "Invalid input message received from %p", socket);
+            return false;
+        }
+        const auto clientData = findClientData(socket);
+        if (!clientData || clientData->platformWindows.isEmpty()) {
+            qCWarning(lcWebGL, "Input message received before connect from %p", socket);
+            return false;
+        }
+        return true;
+    };
+    const auto takeTrace = [this]()
+    {
+        const auto trace = pendingTrace;
+        pendingTrace = QWebGLLatencyTracer::Input();
+        return trace;
+    };
+    const auto inputWindow = [&](WId winId) -> QWindow *
+    {
+        if (!isValidInput())
+            return nullptr;
+        for (auto platformWindow : qAsConst(findClientData(socket)->platformWindows)) {
+            if (platformWindow->winId() == winId)
+                return platformWindow->window();
+        }
+        qCWarning(lcWebGL, "Input message received for an unknown window %llu",
+                  quint64(winId));
+        return nullptr;
+    };
+    switch (type) {
+    case BinaryMessageType::GlResponse: {
+        const auto id = reader.read<quint32>();
+        const auto value = reader.readValue();
+        if (!reader.isValid() || !reader.atEnd()) {
+            qCWarning(lcWebGL, "Invalid gl_response message received from %p", socket);
+            return;
+        }
+        qCDebug(lcWebGL, ) << "gl_response message received" << id << value;
+        handleGlResponse(int(id), value);
+        break;
+    }
+    case BinaryMessageType::Mouse: {
+        InputEvent event;
+        event.type = InputEvent::Type::Mouse;
+        event.trace = takeTrace();
+        const auto winId = reader.read<quint32>();
+        event.time = ulong(reader.readDouble());
+        event.buttons = Qt::MouseButtons(reader.read<quint8>());
+        event.localPos = readPoint(reader);
+        event.globalPos = readPoint(reader);
+        if (auto window = inputWindow(winId)) {
+            event.window = window;
+            handleMouse(*findClientData(socket), event);
+        }
+        break;
+    }
+    case BinaryMessageType::Wheel: {
+        InputEvent event;
+        event.type = InputEvent::Type::Wheel;
+        event.trace = takeTrace();
+        const auto winId = reader.read<quint32>();
+        event.time = ulong(reader.readDouble());
+        event.localPos = readPoint(reader);
+        event.globalPos = readPoint(reader);
+        event.delta = -readPoint(reader).toPoint();
+        if (auto window = inputWindow(winId)) {
+            event.window = window;
+            handleWheel(event);
+        }
+        break;
+    }
+    case BinaryMessageType::Touch: {
+        InputEvent event;
+        event.type = InputEvent::Type::Touch;
+        event.trace = takeTrace();
+        const auto winId = reader.read<quint32>();
+        event.time = ulong(reader.readDouble());
+        const auto phase = TouchPhase(reader.read<quint8>());
+        const int changedCount = reader.read<quint8>();
+        const int count = changedCount + reader.read<quint8>();
+        for (int i = 0; i < count && reader.isValid(); ++i) {
+            QWindowSystemInterface::TouchPoint point;
+            point.id = reader.read<qint32>();
+            const auto client = readPoint(reader);
+            const auto page = readPoint(reader);
+            const auto radius = readPoint(reader);
+            point.pressure = reader.readFloat();
+            point.area = QRectF(page - radius, page + radius);
+            point.normalPosition = readPoint(reader);
+            point.rawPositions = { client };
+            point.state = i < changedCount ? touchPointState(phase) : Qt::TouchPointStationary;
+            event.touchPoints.append(point);
+        }
+        if (phase > TouchPhase::Cancel)
+            reader.invalidate();
+        if (auto window = inputWindow(winId)) {
+            event.window = window;
+            handleTouch(event, phase);
+        }
+        break;
+    }
+    case BinaryMessageType::Key: {
+        const auto trace = takeTrace();
+        const auto phase = KeyPhase(reader.read<quint8>());
+        const auto time = ulong(reader.readDouble());
+        const auto flags = reader.read<quint8>();
+        const auto which = reader.read<quint32>();
+        const auto keyName = reader.readBytes();
+        const auto code = reader.readBytes();
+        if (phase > KeyPhase::Press)
+            reader.invalidate();
+        Qt::KeyboardModifiers modifiers = Qt::NoModifier;
+        if (flags & ControlKey)
+            modifiers |= Qt::ControlModifier;
+        if (flags & ShiftKey)
+            modifiers |= Qt::ShiftModifier;
+        if (flags & AltKey)
+            modifiers |= Qt::AltModifier;
+        if (flags & MetaKey)
+            modifiers |= Qt::MetaModifier;
+        if (isValidInput()) {
+            handleKeyboard(*findClientData(socket), phase, time, keyName, code, int(which),
+                           modifiers, trace);
+        }
+        break;
+    }
+    case BinaryMessageType::InputTrace: {
+        const auto sequence = reader.read<quint32>();
+        if (!reader.isValid() || !reader.atEnd()) {
+            qCWarning(lcWebGL, "Invalid input trace received from %p", socket);
+            return;
+        }
+        if (QWebGLLatencyTracer::isEnabled())
+            pendingTrace = latencyTracer.inputReceived(socket, sequence);
+        break;
+    }
+    case BinaryMessageType::FrameTrace: {
+        const auto sequence = reader.read<quint32>();
+        const auto executeMsecs = reader.readDouble();
+        const auto totalMsecs = reader.readDouble();
+        if (!reader.isValid() || !reader.atEnd()) {
+            qCWarning(lcWebGL, "Invalid frame trace received from %p", socket);
+            return;
+        }
+        if (QWebGLLatencyTracer::isEnabled())
+            latencyTracer.frameExecuted(socket, sequence, executeMsecs, totalMsecs);
+        break;
+    }
+    case BinaryMessageType::ExecutionTrace: {
+        const auto msecs = reader.readDouble();
+        if (!reader.isValid() || !reader.atEnd()) {
+            qCWarning(lcWebGL, "Invalid execution trace received from %p", socket);
+            return;
+        }
+        // Ends when reported, the browser clock is not related to ours
+        if (QWebGLTrace::isEnabled()) {
+            const auto end = QWebGLTrace::now();
+            QWebGLTrace::recordBrowser("execGL", end - qint64(msecs * 1000000), end);
+        }
+        break;
+    }
+    default:
+        qCWarning(lcWebGL, "Unknown binary message type %d received from %p", int(type), socket);
+        break;
+    }
 }
 
 void QWebGLIntegrationPrivate::handleCanvasResize(const ClientData &clientData,
@@ -484,185 +1095,363 @@ void QWebGLIntegrationPrivate::handleCanvasResize(const ClientData &clientData,
     clientData.platformScreen->setGeometry(width, height, physicalWidth, physicalHeight);
 }
 
-void QWebGLIntegrationPrivate::handleMouse(const ClientData &clientData, const QJsonObject &object)
+void QWebGLIntegrationPrivate::handleMouse(ClientData &clientData, const QJsonObject &object)
 {
     const auto winId = object.value("name").toInt(-1);
     Q_ASSERT(winId != -1);
-    QPointF localPos(object.value("layerX").toDouble(),
-                     object.value("layerY").toDouble());
-    QPointF globalPos(object.value("clientX").toDouble(),
-                      object.value("clientY").toDouble());
-    auto buttons = static_cast<Qt::MouseButtons>(object.value("buttons").toInt());
-    auto time = object.value("time").toString();
-    auto platformWindow = findWindow(clientData, winId);
-    QWindowSystemInterface::handleMouseEvent(platformWindow->window(),
-                                             time.toULong(),
-                                             localPos,
-                                             globalPos,
-                                             Qt::MouseButtons(buttons),
-                                             Qt::NoButton,
-                                             QEvent::None,
-                                             Qt::NoModifier,
-                                             Qt::MouseEventNotSynthesized);
+    InputEvent event;
+    event.type = InputEvent::Type::Mouse;
+    event.window = findWindow(clientData, winId)->window();
+    event.time = object.value("time").toString().toULong();
+    event.localPos = QPointF(object.value("layerX").toDouble(),
+                             object.value("layerY").toDouble());
+    event.globalPos = QPointF(object.value("clientX").toDouble(),
+                              object.value("clientY").toDouble());
+    event.buttons = static_cast<Qt::MouseButtons>(object.value("buttons").toInt());
+    handleMouse(clientData, event);
+}
+
+void QWebGLIntegrationPrivate::handleMouse(ClientData &clientData, const InputEvent &event)
+{
+    // Only moves are merged, a press or a release is delivered as is
+    const bool isMove = event.buttons == clientData.mouseButtons;
+    clientData.mouseButtons = event.buttons;
+    if (isMove && isInputCoalescingEnabled()) {
+        queueInput(event);
+    } else {
+        flushInput();
+        deliverInput(event);
+    }
 }
 
 void QWebGLIntegrationPrivate::handleWheel(const ClientData &clientData, const QJsonObject &object)
 {
     const auto winId = object.value("name").toInt(-1);
     Q_ASSERT(winId != -1);
-    auto platformWindow = findWindow(clientData, winId);
-    auto time = object.value("time").toDouble();
-    QPointF localPos(object.value("layerX").toDouble(),
-                     object.value("layerY").toDouble());
-    QPointF globalPos(object.value("clientX").toDouble(),
-                      object.value("clientY").toDouble());
-    const int deltaX = -object.value("deltaX").toInt(0);
-    const int deltaY = -object.value("deltaY").toInt(0);
-    auto orientation = deltaY != 0 ? Qt::Vertical : Qt::Horizontal;
-
-    QPoint point = (orientation == Qt::Vertical) ? QPoint(0, deltaY) : QPoint(deltaX, 0);
-    QWindowSystemInterface::handleWheelEvent(platformWindow->window(),
-                                             time,
-                                             localPos,
-                                             globalPos,
-                                             QPoint(),
-                                             point,
-                                             Qt::NoModifier);
+    InputEvent event;
+    event.type = InputEvent::Type::Wheel;
+    event.window = findWindow(clientData, winId)->window();
+    event.time = ulong(object.value("time").toDouble());
+    event.localPos = QPointF(object.value("layerX").toDouble(),
+                             object.value("layerY").toDouble());
+    event.globalPos = QPointF(object.value("clientX").toDouble(),
+                              object.value("clientY").toDouble());
+    event.delta = QPoint(-object.value("deltaX").toInt(0), -object.value("deltaY").toInt(0));
+    handleWheel(event);
+}
+
+void QWebGLIntegrationPrivate::handleWheel(const InputEvent &event)
+{
+    if (isInputCoalescingEnabled())
+        queueInput(event);
+    else
+        deliverInput(event);
 }
 
 void QWebGLIntegrationPrivate::handleTouch(const ClientData &clientData, const QJsonObject &object)
 {
     const auto winId = object.value("name").toInt(-1);
     Q_ASSERT(winId != -1);
-    auto window = findWindow(clientData, winId)->window();
-    const auto time = object.value("time").toString();
+    InputEvent event;
+    event.type = InputEvent::Type::Touch;
+    event.window = findWindow(clientData, winId)->window();
+    event.time = object.value("time").toString().toULong();
     const auto eventType = object.value("event").toString();
-    if (eventType == QStringLiteral("touchcancel")) {
-        QWindowSystemInterface::handleTouchCancelEvent(window,
-                                                       time.toULong(),
-                                                       touchDevice,
-                                                       Qt::NoModifier);
+    TouchPhase phase;
+    if (eventType == QStringLiteral("touchstart")) {
+        phase = TouchPhase::Start;
+    } else if (eventType == QStringLiteral("touchend")) {
+        qCDebug(lcWebGL, ) << "end" << object;
+        phase = TouchPhase::End;
+    } else if (eventType == QStringLiteral("touchcancel")) {
+        phase = TouchPhase::Cancel;
     } else {
-        QList<QWindowSystemInterface::TouchPoint> points;
-        auto touchToPoint = [](const QJsonValue &touch) -> QWindowSystemInterface::TouchPoint {
-            QWindowSystemInterface::TouchPoint point; // support more than one
-            const auto pageX = touch.toObject().value("pageX").toDouble();
-            const auto pageY = touch.toObject().value("pageY").toDouble();
-            const auto radiusX = touch.toObject().value("radiusX").toDouble();
-            const auto radiusY = touch.toObject().value("radiusY").toDouble();
-            const auto clientX = touch.toObject().value("clientX").toDouble();
-            const auto clientY = touch.toObject().value("clientY").toDouble();
-            point.id = touch.toObject().value("identifier").toInt(0);
-            point.pressure = touch.toObject().value("force").toDouble(1.);
-            point.area.setX(pageX - radiusX);
-            point.area.setY(pageY - radiusY);
-            point.area.setWidth(radiusX * 2);
-            point.area.setHeight(radiusY * 2);
-            point.normalPosition.setX(touch.toObject().value("normalPositionX").toDouble());
-            point.normalPosition.setY(touch.toObject().value("normalPositionY").toDouble());
-            point.rawPositions = {{ clientX, clientY }};
-            return point;
-        };
+        Q_ASSERT(eventType == QStringLiteral("touchmove"));
+        phase = TouchPhase::Move;
+    }
 
+    auto touchToPoint = [](const QJsonValue &touch) -> QWindowSystemInterface::TouchPoint {
+        QWindowSystemInterface::TouchPoint point; // support more than one
+        const auto pageX = touch.toObject().value("pageX").toDouble();
+        const auto pageY = touch.toObject().value("pageY").toDouble();
+        const auto radiusX = touch.toObject().value("radiusX").toDouble();
+        const auto radiusY = touch.toObject().value("radiusY").toDouble();
+        const auto clientX = touch.toObject().value("clientX").toDouble();
+        const auto clientY = touch.toObject().value("clientY").toDouble();
+        point.id = touch.toObject().value("identifier").toInt(0);
+        point.pressure = touch.toObject().value("force").toDouble(1.);
+        point.area.setX(pageX - radiusX);
+        point.area.setY(pageY - radiusY);
+        point.area.setWidth(radiusX * 2);
+        point.area.setHeight(radiusY * 2);
+        point.normalPosition.setX(touch.toObject().value("normalPositionX").toDouble());
+        point.normalPosition.setY(touch.toObject().value("normalPositionY").toDouble());
+        point.rawPositions = {{ clientX, clientY }};
+        return point;
+    };
+    if (phase != TouchPhase::Cancel) {
         for (const auto &touch : object.value("changedTouches").toArray()) {
             auto point = touchToPoint(touch);
-            if (eventType == QStringLiteral("touchstart")) {
-                point.state = Qt::TouchPointPressed;
-            } else if (eventType == QStringLiteral("touchend")) {
-                qCDebug(lcWebGL, ) << "end" << object;
-                point.state = Qt::TouchPointReleased;
-            } else {
-                Q_ASSERT(eventType == QStringLiteral("touchmove"));
-                point.state = Qt::TouchPointMoved;
-            }
-            points.append(point);
+            point.state = touchPointState(phase);
+            event.touchPoints.append(point);
         }
-
         for (const auto &touch : object.value("stationaryTouches").toArray()) {
             auto point = touchToPoint(touch);
             point.state = Qt::TouchPointStationary;
-            points.append(point);
+            event.touchPoints.append(point);
         }
+    }
+    handleTouch(event, phase);
+}
+
+Qt::TouchPointState QWebGLIntegrationPrivate::touchPointState(TouchPhase phase)
+{
+    switch (phase) {
+    case TouchPhase::Start: return Qt::TouchPointPressed;
+    case TouchPhase::End: return Qt::TouchPointReleased;
+    default: return Qt::TouchPointMoved;
+    }
+}
+
+void QWebGLIntegrationPrivate::handleTouch(const InputEvent &event, TouchPhase phase)
+{
+    if (phase == TouchPhase::Cancel) {
+        flushInput();
+        if (event.window) {
+            QWindowSystemInterface::handleTouchCancelEvent(event.window,
+                                                           event.time,
+                                                           touchDevice,
+                                                           Qt::NoModifier);
+        }
+        return;
+    }
+
+    // Presses and releases change the set of touch points and are delivered as they are
+    if (phase == TouchPhase::Move && isInputCoalescingEnabled()) {
+        queueInput(event);
+    } else {
+        flushInput();
+        deliverInput(event);
+    }
+}
+
+bool QWebGLIntegrationPrivate::isInputCoalescingEnabled()
+{
+    static bool enabled = qgetenv("QT_WEBGL_INPUT_COALESCING") != "0";
+    return enabled;
+}
+
+void QWebGLIntegrationPrivate::queueInput(const InputEvent &event)
+{
+    const auto touchPointIds = [](const QList<QWindowSystemInterface::TouchPoint> &points)
+    {
+        QVector<int> ids;
+        ids.reserve(points.size());
+        for (const auto &point : points)
+            ids.append(point.id);
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    };
+    if (pendingInput.type != event.type || pendingInput.window != event.window
+            || (event.type == InputEvent::Type::Touch
+                && touchPointIds(pendingInput.touchPoints) != touchPointIds(event.touchPoints))) {
+        flushInput();
+    }
+
+    // The latest event wins, except for the wheel steps which add up and the latency trace of
+    // the oldest event
+    const auto delta = pendingInput.delta;
+    const auto trace = pendingInput.trace;
+    pendingInput = event;
+    pendingInput.delta += delta;
+    if (trace.sequence)
+        pendingInput.trace = trace;
+
+    if (!inputFlushScheduled) {
+        // Runs once the messages already received have been handled
+        inputFlushScheduled = true;
+        QTimer::singleShot(0, webSocketServer, [this]()
+        {
+            inputFlushScheduled = false;
+            flushInput();
+        });
+    }
+}
+
+void QWebGLIntegrationPrivate::flushInput()
+{
+    if (pendingInput.type == InputEvent::Type::None)
+        return;
+    const auto event = pendingInput;
+    pendingInput = InputEvent();
+    deliverInput(event);
+}
 
-        QWindowSystemInterface::handleTouchEvent(window,
-                                                 time.toULong(),
+void QWebGLIntegrationPrivate::deliverInput(const InputEvent &event)
+{
+    if (!event.window)
+        return;
+    switch (event.type) {
+    case InputEvent::Type::None:
+        break;
+    case InputEvent::Type::Mouse:
+        QWindowSystemInterface::handleMouseEvent(event.window,
+                                                 event.time,
+                                                 event.localPos,
+                                                 event.globalPos,
+                                                 event.buttons,
+                                                 Qt::NoButton,
+                                                 QEvent::None,
+                                                 Qt::NoModifier,
+                                                 Qt::MouseEventNotSynthesized);
+        break;
+    case InputEvent::Type::Wheel:
+        // Both axes, a diagonal scroll or the merged steps of both directions
+        QWindowSystemInterface::handleWheelEvent(event.window,
+                                                 event.time,
+                                                 event.localPos,
+                                                 event.globalPos,
+                                                 QPoint(),
+                                                 event.delta,
+                                                 Qt::NoModifier);
+        break;
+    case InputEvent::Type::Touch:
+        QWindowSystemInterface::handleTouchEvent(event.window,
+                                                 event.time,
                                                  touchDevice,
-                                                 points,
+                                                 event.touchPoints,
                                                  Qt::NoModifier);
+        break;
     }
+    if (event.trace.sequence)
+        latencyTracer.inputDelivered(event.trace);
+}
+
+namespace {
+
+struct SpecialKey
+{
+    const char *name;
+    Qt::Key key;
+};
+
+// Values of KeyboardEvent.key without a text, sorted by name for the binary search
+constexpr SpecialKey specialKeys[] = {
+    { "Alt", Qt::Key_Alt },
+    { "AltGraph", Qt::Key_AltGr },
+    { "ArrowDown", Qt::Key_Down },
+    { "ArrowLeft", Qt::Key_Left },
+    { "ArrowRight", Qt::Key_Right },
+    { "ArrowUp", Qt::Key_Up },
+    { "Backspace", Qt::Key_Backspace },
+    { "Control", Qt::Key_Control },
+    { "Delete", Qt::Key_Delete },
+    { "End", Qt::Key_End },
+    { "Enter", Qt::Key_Enter },
+    { "Escape", Qt::Key_Escape },
+    { "F1", Qt::Key_F1 },
+    { "F10", Qt::Key_F10 },
+    { "F11", Qt::Key_F11 },
+    { "F12", Qt::Key_F12 },
+    { "F2", Qt::Key_F2 },
+    { "F3", Qt::Key_F3 },
+    { "F4", Qt::Key_F4 },
+    { "F5", Qt::Key_F5 },
+    { "F6", Qt::Key_F6 },
+    { "F7", Qt::Key_F7 },
+    { "F8", Qt::Key_F8 },
+    { "F9", Qt::Key_F9 },
+    { "Home", Qt::Key_Home },
+    { "Insert", Qt::Key_Insert },
+    { "Meta", Qt::Key_Meta },
+    { "OS", Qt::Key_Super_L },
+    { "PageDown", Qt::Key_PageDown },
+    { "PageUp", Qt::Key_PageUp },
+    { "Shift", Qt::Key_Shift },
+    { "Space", Qt::Key_Space },
+    { "Tab", Qt::Key_Tab },
+    { "Unidentified", Qt::Key_F }
+};
+
+const SpecialKey *findSpecialKey(const QByteArray &name)
+{
+    const auto lessThan = [](const SpecialKey &specialKey, const char *name)
+    {
+        return qstrcmp(specialKey.name, name) < 0;
+    };
+    const auto begin = std::begin(specialKeys);
+    const auto end = std::end(specialKeys);
+    Q_ASSERT(std::is_sorted(begin, end, [](const SpecialKey &a, const SpecialKey &b)
+    {
+        return qstrcmp(a.name, b.name) < 0;
+    }));
+    const auto it = std::lower_bound(begin, end, name.constData(), lessThan);
+    return it != end && name == it->name ? it : nullptr;
+}
+
 }
 
 void QWebGLIntegrationPrivate::handleKeyboard(const ClientData &clientData,
                                               const QString &type,
                                               const QJsonObject &object)
 {
-    const QHash<QString, Qt::Key> keyMap {
-        { "Alt", Qt::Key_Alt },
-        { "ArrowDown", Qt::Key_Down },
-        { "ArrowLeft", Qt::Key_Left },
-        { "ArrowRight", Qt::Key_Right },
-        { "ArrowUp", Qt::Key_Up },
-        { "Backspace", Qt::Key_Backspace },
-        { "Control", Qt::Key_Control },
-        { "Delete", Qt::Key_Delete },
-        { "End", Qt::Key_End },
-        { "Enter", Qt::Key_Enter },
-        { "F1", Qt::Key_F1 },
-        { "F2", Qt::Key_F2 },
-        { "F3", Qt::Key_F3 },
-        { "F4", Qt::Key_F4 },
-        { "F5", Qt::Key_F5 },
-        { "F6", Qt::Key_F6 },
-        { "F7", Qt::Key_F7 },
-        { "F8", Qt::Key_F8 },
-        { "F9", Qt::Key_F9 },
-        { "F10", Qt::Key_F10 },
-        { "F11", Qt::Key_F11 },
-        { "F12", Qt::Key_F12 },
-        { "Escape", Qt::Key_Escape },
-        { "Home", Qt::Key_Home },
-        { "Insert", Qt::Key_Insert },
-        { "Meta", Qt::Key_Meta },
-        { "PageDown", Qt::Key_PageDown },
-        { "PageUp", Qt::Key_PageUp },
-        { "Shift", Qt::Key_Shift },
-        { "Space", Qt::Key_Space },
-        { "AltGraph", Qt::Key_AltGr },
-        { "Tab", Qt::Key_Tab },
-        { "Unidentified", Qt::Key_F },
-        { "OS", Qt::Key_Super_L }
-    };
-    const auto timestamp = static_cast<ulong>(object.value("time").toDouble(-1));
-    const auto keyName = object.value("key").toString();
-    const auto specialKey = keyMap.find(keyName);
-    QEvent::Type eventType;
+    KeyPhase phase;
     if (type == QStringLiteral("keydown"))
-        eventType = QEvent::KeyPress;
+        phase = KeyPhase::Down;
     else if (type == QStringLiteral("keyup"))
+        phase = KeyPhase::Up;
+    else
+        phase = KeyPhase::Press;
+    handleKeyboard(clientData,
+                   phase,
+                   static_cast<ulong>(object.value("time").toDouble(-1)),
+                   object.value("key").toString().toUtf8(),
+                   object.value("code").toString().toUtf8(),
+                   object.value("which").toInt(0),
+                   convertKeyboardModifiers(object));
+}
+
+void QWebGLIntegrationPrivate::handleKeyboard(const ClientData &clientData,
+                                              KeyPhase phase,
+                                              ulong time,
+                                              const QByteArray &keyName,
+                                              const QByteArray &code,
+                                              int which,
+                                              Qt::KeyboardModifiers modifiers,
+                                              const QWebGLLatencyTracer::Input &trace)
+{
+    flushInput(); // Delivered after the moves received before it
+    QEvent::Type eventType;
+    if (phase == KeyPhase::Down)
+        eventType = QEvent::KeyPress;
+    else if (phase == KeyPhase::Up)
         eventType = QEvent::KeyRelease;
     else
         return;
-    QString string(object.value("key").toString());
-    int key = object.value("which").toInt(0);
-    if (specialKey != keyMap.end()) {
-        key = *specialKey;
-        string.clear();
+    QString string;
+    int key = which;
+    if (const auto specialKey = findSpecialKey(keyName)) {
+        key = specialKey->key;
 
         // special case: match Qt's behavior on other platforms and differentiate:
         // * "Enter": Qt::Key_Return
         // * "NumpadEnter": Qt::Key_Enter
         // TODO: consider whether "code" could be used rather than "keyName" above
-        if (key == Qt::Key_Enter && object.value("code").toString() == QStringLiteral("Enter"))
+        if (key == Qt::Key_Enter && code == "Enter")
             key = Qt::Key_Return;
+    } else {
+        string = QString::fromUtf8(keyName);
     }
 
     const auto window = clientData.platformWindows.last()->window();
     QWindowSystemInterface::handleKeyEvent(window,
-                                           timestamp,
+                                           time,
                                            eventType,
                                            key,
-                                           convertKeyboardModifiers(object),
+                                           modifiers,
                                            string);
+    if (trace.sequence)
+        latencyTracer.inputDelivered(trace);
 }
 
 Qt::KeyboardModifiers QWebGLIntegrationPrivate::convertKeyboardModifiers(const QJsonObject &object)
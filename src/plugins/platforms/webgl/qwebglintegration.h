@@ -37,6 +37,7 @@
 
 QT_BEGIN_NAMESPACE
 
+class QIODevice;
 class QPlatformSurface;
 class QWebGLIntegrationPrivate;
 
@@ -67,8 +68,13 @@ public:
 
     QPlatformNativeInterface *nativeInterface() const override;
 
+    NativeResourceForIntegrationFunction nativeResourceFunctionForIntegration(
+            const QByteArray &resource) override;
+
     void openUrl(const QUrl &url);
 
+    static void setCustomRequestDevice(const QString &path, QIODevice *device);
+
 private:
     Q_DISABLE_COPY(QWebGLIntegration)
     Q_DECLARE_PRIVATE(QWebGLIntegration)
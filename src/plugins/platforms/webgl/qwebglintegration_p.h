@@ -32,12 +32,19 @@
 
 #include "qwebglscreen.h"
 #include "qwebglhttpserver.h"
+#include "qwebgllatencytracer.h"
 #include "qwebglplatformservices.h"
 #include "qwebglwebsocketserver.h"
 
+#include <QtCore/qatomic.h>
 #include <QtCore/qmutex.h>
+#include <QtCore/qpointer.h>
+#include <QtCore/qvariant.h>
+#include <QtCore/qvector.h>
 #include <QtCore/qwaitcondition.h>
 #include <QtGui/qpa/qplatforminputcontextfactory_p.h>
+#include <QtGui/qpa/qwindowsysteminterface.h>
+#include <QtGui/qwindow.h>
 
 #if defined(Q_OS_WIN)
 #include <QtFontDatabaseSupport/private/qwindowsfontdatabase_p.h>
@@ -51,10 +58,15 @@
 #include <QtEventDispatcherSupport/private/qgenericunixeventdispatcher_p.h>
 #endif // Q_OS_WIN
 
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
 QT_BEGIN_NAMESPACE
 
 class QWebSocket;
 class QWebGLIntegration;
+class QWebGLSessionManager;
 
 class QWebGLIntegrationPrivate
 {
@@ -66,8 +78,45 @@ public:
     {
         QList<QWebGLWindow *> platformWindows;
         QWebSocket *socket;
+        // The socket while it is connected, null otherwise. Changed by the WebSocket thread, it
+        // is what the render threads check instead of the state of the socket.
+        QAtomicPointer<QWebSocket> connectedSocket;
         QWebGLScreen *platformScreen = nullptr;
+        bool supportsImageBitmap = false;
+        bool supportsDecompressionStream = false;
+        bool supportsFloatTextures = false;
+        bool supportsHalfFloatTextures = false;
+        QMap<unsigned int, QVariant> defaultContextParameters; // sent with the connect message
+        QVector<QWebSocket *> viewers; // broadcast mode, changed by the WebSocket thread only
+        Qt::MouseButtons mouseButtons; // of the last mouse record, used by the WebSocket thread
+    };
+
+    // First byte of the binary messages sent by the browser. The input records have a fixed
+    // layout, big endian, with times in milliseconds since the epoch:
+    // Mouse: u32 window, f64 time, u8 buttons, f32 layerX, layerY, clientX, clientY
+    // Wheel: u32 window, f64 time, f32 layerX, layerY, clientX, clientY, deltaX, deltaY
+    // Touch: u32 window, f64 time, u8 TouchPhase, u8 changed count, u8 stationary count, then
+    //        per point i32 identifier, f32 clientX, clientY, pageX, pageY, radiusX, radiusY,
+    //        force, normalPositionX, normalPositionY
+    // Key: u8 KeyPhase, f64 time, u8 KeyModifier flags, u32 which, bytes key, bytes code
+    // With latency tracing, an InputTrace (u32 sequence) precedes the input record it tags, and
+    // a FrameTrace (u32 sequence, f64 execution and total milliseconds) reports the execution
+    // of the frame tagged with that sequence, see QWebGLLatencyTracer
+    // With QT_WEBGL_TRACE, an ExecutionTrace (f64 milliseconds) follows the execution of each
+    // frame, see QWebGLTrace
+    enum class BinaryMessageType : quint8 {
+        GlResponse = 1,
+        Mouse,
+        Wheel,
+        Touch,
+        Key,
+        InputTrace,
+        FrameTrace,
+        ExecutionTrace
     };
+    enum class TouchPhase : quint8 { Start, Move, End, Cancel };
+    enum class KeyPhase : quint8 { Down, Up, Press };
+    enum KeyModifier : quint8 { ControlKey = 1, ShiftKey = 2, AltKey = 4, MetaKey = 8 };
 
     mutable QPlatformInputContext *inputContext = nullptr;
     quint16 httpPort = 0;
@@ -81,6 +130,7 @@ public:
 #endif
     mutable QWebGLPlatformServices services;
     QWebGLHttpServer *httpServer = nullptr;
+    QWebGLSessionManager *sessionManager = nullptr;
     QWebGLWebSocketServer *webSocketServer = nullptr;
     QWebGLScreen *screen = nullptr;
     QThread *webSocketServerThread = nullptr;
@@ -90,12 +140,67 @@ public:
     } clients;
     mutable QList<QWindow *> windows;
 
-    QMutex waitMutex;
+    QMutex waitMutex; // Used with waitCondition for the startup of the WebSocket server
     QWaitCondition waitCondition;
-    QList<int> pendingResponses;
-    QHash<int, QVariant> receivedResponses;
+
+    // Completion token of the blocking calls of a thread, reused by all of them since a thread
+    // waits for one call at a time. Completed by the WebSocket thread with the gl_response, or
+    // with an invalid value when the client goes away.
+    struct ResponseToken
+    {
+        void reset(int id);
+        void complete(int id, const QVariant &value);
+        // False if the token waits for another call or the timeout (ms) expires
+        bool wait(int id, QVariant *value, unsigned long timeout = ULONG_MAX);
+
+        QMutex mutex;
+        QWaitCondition condition;
+        int id = -1;
+        bool ready = false;
+        QVariant value;
+    };
+
+    // Calls waiting for a gl_response. Asynchronous calls set a callback instead of a token.
+    using ResponseCallback = std::function<void(const QVariant &)>;
+    struct PendingResponse
+    {
+        QWebSocket *socket;
+        std::shared_ptr<ResponseToken> token;
+        ResponseCallback callback;
+    };
+    QMutex pendingResponsesMutex;
+    std::unordered_map<int, PendingResponse> pendingResponses;
+
+    void expectResponse(int id, const ClientData &clientData,
+                        const std::shared_ptr<ResponseToken> &token);
+    void expectResponse(int id, const ClientData &clientData, ResponseCallback callback);
+    void cancelResponses(QWebSocket *socket);
     QTouchDevice *touchDevice = nullptr;
 
+    // Moves and wheel steps wait for the end of the current burst of messages and are merged
+    // with the ones following them, see queueInput. Only used by the WebSocket thread.
+    struct InputEvent
+    {
+        enum class Type { None, Mouse, Wheel, Touch } type = Type::None;
+        QPointer<QWindow> window;
+        ulong time = 0;
+        QPointF localPos;
+        QPointF globalPos;
+        Qt::MouseButtons buttons;
+        QPoint delta;
+        QList<QWindowSystemInterface::TouchPoint> touchPoints;
+        QWebGLLatencyTracer::Input trace;
+    };
+    InputEvent pendingInput;
+    bool inputFlushScheduled = false;
+    QWebGLLatencyTracer::Input pendingTrace; // tags the next input record
+    QWebGLLatencyTracer latencyTracer;
+
+    static bool isInputCoalescingEnabled();
+    void queueInput(const InputEvent &event);
+    void flushInput();
+    void deliverInput(const InputEvent &event);
+
     ClientData *findClientData(const QWebSocket *socket);
     ClientData *findClientData(const QPlatformSurface *surface);
     QWebGLWindow *findWindow(const ClientData &clientData, WId winId);
@@ -104,24 +209,49 @@ public:
                            const int width,
                            const int height,
                            const double physicalWidth,
-                           const double physicalHeight);
+                           const double physicalHeight,
+                           const bool supportsImageBitmap,
+                           const bool supportsDecompressionStream,
+                           const bool supportsFloatTextures,
+                           const bool supportsHalfFloatTextures,
+                           const QMap<unsigned int, QVariant> &defaults);
     void clientDisconnected(QWebSocket *socket);
 
     void connectNextClient();
+    void resumeClient(const ClientData &clientData);
+    static bool isBroadcastEnabled();
+    void addViewer(ClientData &clientData, QWebSocket *socket);
+    bool isViewer(const QWebSocket *socket);
+    void sendCreateCanvas(QWebSocket *socket, QWebGLWindow *platformWindow) const;
 
     void sendMessage(QWebSocket *socket,
                      QWebGLWebSocketServer::MessageType type,
                      const QVariantMap &values) const;
     void onTextMessageReceived(QWebSocket *socket, const QString &message);
+    void onBinaryMessageReceived(QWebSocket *socket, const QByteArray &message);
+    static QMap<unsigned int, QVariant> contextParameters(const QJsonObject &object);
     void handleDefaultContextParameters(const ClientData &clientData, const QJsonObject &object);
     void handleGlResponse(const QJsonObject &object);
+    void handleGlResponse(int id, const QVariant &value);
     void handleCanvasResize(const ClientData &clientData, const QJsonObject &object);
-    void handleMouse(const ClientData &clientData, const QJsonObject &object);
+    void handleMouse(ClientData &clientData, const QJsonObject &object);
+    void handleMouse(ClientData &clientData, const InputEvent &event);
     void handleWheel(const ClientData &clientData, const QJsonObject &object);
+    void handleWheel(const InputEvent &event);
     void handleTouch(const ClientData &clientData, const QJsonObject &object);
+    void handleTouch(const InputEvent &event, TouchPhase phase);
+    static Qt::TouchPointState touchPointState(TouchPhase phase);
     void handleKeyboard(const ClientData &clientData,
                         const QString &type,
                         const QJsonObject &object);
+    void handleKeyboard(const ClientData &clientData,
+                        KeyPhase phase,
+                        ulong time,
+                        const QByteArray &keyName,
+                        const QByteArray &code,
+                        int which,
+                        Qt::KeyboardModifiers modifiers,
+                        const QWebGLLatencyTracer::Input &trace = QWebGLLatencyTracer::Input());
 
     Qt::KeyboardModifiers convertKeyboardModifiers(const QJsonObject &object);
 
@@ -0,0 +1,135 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qwebgllatencytracer.h"
+#include "qwebglintegration_p.h"
+
+#include <QtCore/qalgorithms.h>
+#include <QtCore/qloggingcategory.h>
+
+#include <algorithm>
+
+QT_BEGIN_NAMESPACE
+
+static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.latency")
+
+QWebGLLatencyTracer::QWebGLLatencyTracer()
+{
+    timer.start();
+}
+
+bool QWebGLLatencyTracer::isEnabled()
+{
+    static const bool enabled = []() {
+        const auto value = qgetenv("QT_WEBGL_LATENCY_TRACING");
+        return !value.isEmpty() && value != "0";
+    }();
+    return enabled;
+}
+
+QWebGLLatencyTracer::Input QWebGLLatencyTracer::inputReceived(const QWebSocket *socket,
+                                                              quint32 sequence) const
+{
+    Input input;
+    input.socket = socket;
+    input.sequence = sequence;
+    input.received = timer.nsecsElapsed();
+    return input;
+}
+
+void QWebGLLatencyTracer::inputDelivered(const Input &input)
+{
+    if (!input.sequence)
+        return;
+    const auto now = timer.nsecsElapsed();
+    QMutexLocker locker(&mutex);
+    record(Dispatch, now - input.received);
+    // The oldest input waiting for a frame gives the latency of the frame
+    auto &client = clients[input.socket];
+    if (!client.delivered) {
+        client.delivered = input.sequence;
+        client.deliveredAt = now;
+    }
+}
+
+quint32 QWebGLLatencyTracer::frameSwapped(const QWebSocket *socket)
+{
+    const auto now = timer.nsecsElapsed();
+    QMutexLocker locker(&mutex);
+    const auto it = clients.find(socket);
+    if (it == clients.end() || !it->delivered)
+        return 0;
+    record(Render, now - it->deliveredAt);
+    it->swapped = it->delivered;
+    it->swappedAt = now;
+    it->delivered = 0;
+    return it->swapped;
+}
+
+void QWebGLLatencyTracer::frameExecuted(const QWebSocket *socket, quint32 sequence,
+                                        double executeMsecs, double totalMsecs)
+{
+    const auto now = timer.nsecsElapsed();
+    QMutexLocker locker(&mutex);
+    const auto it = clients.find(socket);
+    if (it != clients.end() && it->swapped == sequence) {
+        record(Present, now - it->swappedAt);
+        it->swapped = 0;
+    }
+    record(Execute, qint64(executeMsecs * 1000000));
+    record(Total, qint64(totalMsecs * 1000000));
+    qCDebug(lc, "Input %u shown after %.3f ms (%.3f ms of GL execution) on %p", sequence,
+            totalMsecs, executeMsecs, socket);
+}
+
+void QWebGLLatencyTracer::clientDisconnected(const QWebSocket *socket)
+{
+    QMutexLocker locker(&mutex);
+    clients.remove(socket);
+}
+
+int QWebGLLatencyTracer::latencyHistogram(int stage, quint64 *counts, int size)
+{
+    if (stage < 0 || stage >= StageCount)
+        return 0;
+    auto &tracer = QWebGLIntegrationPrivate::instance()->latencyTracer;
+    QMutexLocker locker(&tracer.mutex);
+    const auto &histogram = tracer.histograms[stage];
+    std::copy(histogram, histogram + qBound(0, size, bucketCount), counts);
+    return bucketCount;
+}
+
+void QWebGLLatencyTracer::record(Stage stage, qint64 nsecs)
+{
+    const auto usecs = quint64(qMax(nsecs, qint64(0)) / 1000);
+    const int bucket = usecs ? 64 - qCountLeadingZeroBits(usecs) : 0;
+    ++histograms[stage][qMin(bucket, bucketCount - 1)];
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,103 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QWEBGLLATENCYTRACER_H
+#define QWEBGLLATENCYTRACER_H
+
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qmutex.h>
+
+QT_BEGIN_NAMESPACE
+
+class QWebSocket;
+
+// Follows the browser input events tagged with a sequence number to the first frame swapped
+// after their delivery, and keeps a latency histogram per stage. Enabled with
+// QT_WEBGL_LATENCY_TRACING, the methods are thread-safe.
+class QWebGLLatencyTracer
+{
+public:
+    enum Stage {
+        Dispatch, // input message received -> delivered to QWindowSystemInterface
+        Render,   // delivered -> swapBuffers called by the render thread
+        Present,  // swapBuffers -> frame execution reported by the browser, network included
+        Execute,  // GL execution of the frame by the browser
+        Total,    // browser input event -> frame executed, measured by the browser
+        StageCount
+    };
+
+    // Bucket 0 counts the latencies below 1 us, bucket i the ones from 2^(i-1) to 2^i us, the
+    // last bucket everything above
+    static const int bucketCount = 24;
+
+    // A browser input event on its way to the application
+    struct Input
+    {
+        const QWebSocket *socket = nullptr;
+        quint32 sequence = 0; // 0 when the event is not traced
+        qint64 received = 0;
+    };
+
+    QWebGLLatencyTracer();
+
+    static bool isEnabled();
+
+    Input inputReceived(const QWebSocket *socket, quint32 sequence) const;
+    void inputDelivered(const Input &input);
+    // Sequence number of the input shown by the frame being swapped, or 0
+    quint32 frameSwapped(const QWebSocket *socket);
+    void frameExecuted(const QWebSocket *socket, quint32 sequence, double executeMsecs,
+                       double totalMsecs);
+    void clientDisconnected(const QWebSocket *socket);
+
+    // Copies up to 'size' bucket counts of 'stage' to 'counts' and returns the number of
+    // buckets. Exposed through the native interface as "latencyHistogram".
+    static int latencyHistogram(int stage, quint64 *counts, int size);
+
+private:
+    struct Client
+    {
+        quint32 delivered = 0;
+        qint64 deliveredAt = 0;
+        quint32 swapped = 0;
+        qint64 swappedAt = 0;
+    };
+
+    void record(Stage stage, qint64 nsecs);
+
+    QElapsedTimer timer;
+    QMutex mutex;
+    QHash<const QWebSocket *, Client> clients;
+    quint64 histograms[StageCount][bucketCount] = {};
+};
+
+QT_END_NAMESPACE
+
+#endif // QWEBGLLATENCYTRACER_H
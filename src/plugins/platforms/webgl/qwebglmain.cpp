@@ -74,8 +74,65 @@ QPlatformIntegration* QWebGLIntegrationPlugin::create(const QString& system,
                     qCCritical(lcWebGL, "Invalid websocket port number");
                     return nullptr;
                 }
-            } else if (parts.first() == QStringLiteral("noloadingscreen"))
+            } else if (parts.first() == QStringLiteral("noloadingscreen")) {
                 qputenv("QT_WEBGL_LOADINGSCREEN", "0");
+            } else if (parts.first() == QStringLiteral("noinputcoalescing")) {
+                qputenv("QT_WEBGL_INPUT_COALESCING", "0");
+            } else if (parts.first() == QStringLiteral("texturecodec")) {
+                if (parts.size() != 2) {
+                    qCCritical(lcWebGL, "Texture codec specified with no value");
+                    return nullptr;
+                }
+                qputenv("QT_WEBGL_TEXTURE_CODEC", parts.last().toLatin1());
+            } else if (parts.first() == QStringLiteral("texturequality")) {
+                if (parts.size() != 2) {
+                    qCCritical(lcWebGL, "Texture quality specified with no value");
+                    return nullptr;
+                }
+                qputenv("QT_WEBGL_TEXTURE_QUALITY", parts.last().toLatin1());
+            } else if (parts.first() == QStringLiteral("geometrycodec")) {
+                qputenv("QT_WEBGL_GEOMETRY_CODEC", "1");
+            } else if (parts.first() == QStringLiteral("optimisticqueries")) {
+                qputenv("QT_WEBGL_OPTIMISTIC_QUERIES", "1");
+            } else if (parts.first() == QStringLiteral("resume")) {
+                qputenv("QT_WEBGL_RESUME", "1");
+            } else if (parts.first() == QStringLiteral("broadcast")) {
+                qputenv("QT_WEBGL_BROADCAST", "1");
+            } else if (parts.first() == QStringLiteral("iothreads")) {
+                if (parts.size() != 2) {
+                    qCCritical(lcWebGL, "I/O thread count specified with no value");
+                    return nullptr;
+                }
+                qputenv("QT_WEBGL_IO_THREADS", parts.last().toLatin1());
+            } else if (parts.first() == QStringLiteral("singleport")) {
+                qputenv("QT_WEBGL_SINGLE_PORT", "1");
+            } else if (parts.first() == QStringLiteral("localsocket")) {
+                if (parts.size() != 2) {
+                    qCCritical(lcWebGL, "Local socket specified with no path");
+                    return nullptr;
+                }
+                qputenv("QT_WEBGL_LOCAL_SOCKET", parts.last().toLocal8Bit());
+            } else if (parts.first() == QStringLiteral("sessions")) {
+                if (parts.size() != 2) {
+                    qCCritical(lcWebGL, "Session pool size specified with no value");
+                    return nullptr;
+                }
+                qputenv("QT_WEBGL_SESSIONS", parts.last().toLatin1());
+            } else if (parts.first() == QStringLiteral("maxworkers")) {
+                if (parts.size() != 2) {
+                    qCCritical(lcWebGL, "Maximum worker count specified with no value");
+                    return nullptr;
+                }
+                qputenv("QT_WEBGL_MAX_WORKERS", parts.last().toLatin1());
+            } else if (parts.first() == QStringLiteral("latencytracing")) {
+                qputenv("QT_WEBGL_LATENCY_TRACING", "1");
+            } else if (parts.first() == QStringLiteral("trace")) {
+                if (parts.size() != 2) {
+                    qCCritical(lcWebGL, "Trace specified with no file name");
+                    return nullptr;
+                }
+                qputenv("QT_WEBGL_TRACE", parts.last().toLocal8Bit());
+            }
         }
     }
     if (!system.compare(QLatin1String("webgl"), Qt::CaseInsensitive))
@@ -0,0 +1,360 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qwebglpixelconversion.h"
+
+#include <QtCore/qfloat16.h>
+#include <QtCore/private/qsimd_p.h>
+
+#include <cstring>
+
+QT_BEGIN_NAMESPACE
+
+namespace QWebGLPixelConversion
+{
+
+// The scalar versions handle the tails of the vectorized loops and must produce identical output
+
+static inline void swizzleBgraToRgbaScalar(const uchar *source, uchar *destination, int count)
+{
+    for (int i = 0; i < count; ++i, source += 4, destination += 4) {
+        destination[0] = source[2];
+        destination[1] = source[1];
+        destination[2] = source[0];
+        destination[3] = source[3];
+    }
+}
+
+static inline void packRgba4444Scalar(const uchar *source, quint16 *destination, int count)
+{
+    for (int i = 0; i < count; ++i, source += 4) {
+        destination[i] = quint16(((source[0] & 0xf0) << 8) | ((source[1] & 0xf0) << 4)
+                                 | (source[2] & 0xf0) | (source[3] >> 4));
+    }
+}
+
+static inline void packRgb565Scalar(const uchar *source, quint16 *destination, int count)
+{
+    for (int i = 0; i < count; ++i, source += 3) {
+        destination[i] = quint16(((source[0] & 0xf8) << 8) | ((source[1] & 0xfc) << 3)
+                                 | (source[2] >> 3));
+    }
+}
+
+#if defined(QT_COMPILER_SUPPORTS_AVX2)
+QT_FUNCTION_TARGET(AVX2)
+static int swizzleBgraToRgbaAvx2(const uchar *source, uchar *destination, int count)
+{
+    const __m256i mask = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                          2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    int i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(source + i * 4));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i * 4),
+                            _mm256_shuffle_epi8(pixels, mask));
+    }
+    return i;
+}
+#endif
+
+void swizzleBgraToRgba(const uchar *source, uchar *destination, int pixelCount)
+{
+    int i = 0;
+#if defined(QT_COMPILER_SUPPORTS_AVX2)
+    if (qCpuHasFeature(AVX2))
+        i = swizzleBgraToRgbaAvx2(source, destination, pixelCount);
+#endif
+#if defined(__SSE2__)
+    // Swap bytes 0 and 2 of every 32 bit pixel, keep 1 and 3
+    const __m128i keepMask = _mm_set1_epi32(int(0xff00ff00));
+    const __m128i lowMask = _mm_set1_epi32(0x000000ff);
+    const __m128i highMask = _mm_set1_epi32(0x00ff0000);
+    for (; i + 4 <= pixelCount; i += 4) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(source + i * 4));
+        __m128i result = _mm_and_si128(pixels, keepMask);
+        result = _mm_or_si128(result, _mm_and_si128(_mm_srli_epi32(pixels, 16), lowMask));
+        result = _mm_or_si128(result, _mm_and_si128(_mm_slli_epi32(pixels, 16), highMask));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i * 4), result);
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    for (; i + 16 <= pixelCount; i += 16) {
+        uint8x16x4_t pixels = vld4q_u8(source + i * 4);
+        const uint8x16_t blue = pixels.val[0];
+        pixels.val[0] = pixels.val[2];
+        pixels.val[2] = blue;
+        vst4q_u8(destination + i * 4, pixels);
+    }
+#endif
+    swizzleBgraToRgbaScalar(source + i * 4, destination + i * 4, pixelCount - i);
+}
+
+void swizzleBgraToRgbaF(const float *source, float *destination, int pixelCount)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    for (; i < pixelCount; ++i) {
+        const __m128 pixel = _mm_loadu_ps(source + i * 4);
+        _mm_storeu_ps(destination + i * 4, _mm_shuffle_ps(pixel, pixel, _MM_SHUFFLE(3, 0, 1, 2)));
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        destination[i * 4 + 0] = source[i * 4 + 2];
+        destination[i * 4 + 1] = source[i * 4 + 1];
+        destination[i * 4 + 2] = source[i * 4 + 0];
+        destination[i * 4 + 3] = source[i * 4 + 3];
+    }
+}
+
+void packRgba4444(const uchar *source, quint16 *destination, int pixelCount)
+{
+    int i = 0;
+#if defined(__SSE2__)
+    const __m128i redMask = _mm_set1_epi32(0x000000f0);
+    const __m128i greenMask = _mm_set1_epi32(0x0000f000);
+    const __m128i blueMask = _mm_set1_epi32(0x00f00000);
+    // _mm_packs_epi32 saturates signed values, bias the 16 bit results into the signed range
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16(short(0x8000));
+    const auto pack = [&](__m128i pixels) {
+        __m128i result = _mm_slli_epi32(_mm_and_si128(pixels, redMask), 8);
+        result = _mm_or_si128(result, _mm_srli_epi32(_mm_and_si128(pixels, greenMask), 4));
+        result = _mm_or_si128(result, _mm_srli_epi32(_mm_and_si128(pixels, blueMask), 16));
+        result = _mm_or_si128(result, _mm_srli_epi32(pixels, 28));
+        return _mm_sub_epi32(result, bias32);
+    };
+    for (; i + 8 <= pixelCount; i += 8) {
+        const auto in = reinterpret_cast<const __m128i *>(source + i * 4);
+        const __m128i low = pack(_mm_loadu_si128(in));
+        const __m128i high = pack(_mm_loadu_si128(in + 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(destination + i),
+                         _mm_xor_si128(_mm_packs_epi32(low, high), bias16));
+    }
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const uint8x16_t highNibbles = vdupq_n_u8(0xf0);
+    for (; i + 16 <= pixelCount; i += 16) {
+        const uint8x16x4_t pixels = vld4q_u8(source + i * 4);
+        uint8x16x2_t result;
+        result.val[0] = vorrq_u8(vandq_u8(pixels.val[2], highNibbles),
+                                 vshrq_n_u8(pixels.val[3], 4));
+        result.val[1] = vorrq_u8(vandq_u8(pixels.val[0], highNibbles),
+                                 vshrq_n_u8(pixels.val[1], 4));
+        vst2q_u8(reinterpret_cast<uint8_t *>(destination + i), result);
+    }
+#endif
+    packRgba4444Scalar(source + i * 4, destination + i, pixelCount - i);
+}
+
+void packRgb565(const uchar *source, quint16 *destination, int pixelCount)
+{
+    int i = 0;
+    // 24 bit pixels do not map onto SSE2 lanes without SSSE3 shuffles, x86 uses the scalar loop
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const uint8x16_t redMask = vdupq_n_u8(0xf8);
+    const uint8x16_t greenMask = vdupq_n_u8(0x1c);
+    for (; i + 16 <= pixelCount; i += 16) {
+        const uint8x16x3_t pixels = vld3q_u8(source + i * 3);
+        uint8x16x2_t result;
+        result.val[0] = vorrq_u8(vshlq_n_u8(vandq_u8(pixels.val[1], greenMask), 3),
+                                 vshrq_n_u8(pixels.val[2], 3));
+        result.val[1] = vorrq_u8(vandq_u8(pixels.val[0], redMask),
+                                 vshrq_n_u8(pixels.val[1], 5));
+        vst2q_u8(reinterpret_cast<uint8_t *>(destination + i), result);
+    }
+#endif
+    packRgb565Scalar(source + i * 3, destination + i, pixelCount - i);
+}
+
+void floatToHalf(const float *source, quint16 *destination, int count)
+{
+    // Vectorized with F16C or NEON by QtCore where the CPU supports it
+    qFloatToFloat16(reinterpret_cast<qfloat16 *>(destination), source, count);
+}
+
+// copyAndHash() runs eight independent 32 bit lanes of h = (h ^ word) * hashPrime over 32 byte
+// blocks, so every vector width produces the same result as the scalar loop.
+static const int hashLanes = 8;
+static const int hashBlockSize = hashLanes * 4;
+static const quint32 hashPrime = 0x9e3779b1u;
+static const quint32 hashSeed = 0x811c9dc5u;
+
+static inline void hashBlocksScalar(const char *source, char *destination, int blockCount,
+                                    quint32 *lanes, quint32 *accumulator)
+{
+    for (int i = 0; i < blockCount; ++i, source += hashBlockSize) {
+        quint32 words[hashLanes];
+        std::memcpy(words, source, hashBlockSize);
+        if (destination) {
+            std::memcpy(destination, source, hashBlockSize);
+            destination += hashBlockSize;
+        }
+        for (int lane = 0; lane < hashLanes; ++lane) {
+            *accumulator |= words[lane];
+            lanes[lane] = (lanes[lane] ^ words[lane]) * hashPrime;
+        }
+    }
+}
+
+#if defined(QT_COMPILER_SUPPORTS_AVX2)
+QT_FUNCTION_TARGET(AVX2)
+static void hashBlocksAvx2(const char *source, char *destination, int blockCount,
+                           quint32 *lanes, quint32 *accumulator)
+{
+    const __m256i prime = _mm256_set1_epi32(int(hashPrime));
+    __m256i hash = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(lanes));
+    __m256i bits = _mm256_setzero_si256();
+    for (int i = 0; i < blockCount; ++i) {
+        const __m256i words = _mm256_loadu_si256(
+                    reinterpret_cast<const __m256i *>(source + i * hashBlockSize));
+        if (destination) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(destination + i * hashBlockSize),
+                                words);
+        }
+        bits = _mm256_or_si256(bits, words);
+        hash = _mm256_mullo_epi32(_mm256_xor_si256(hash, words), prime);
+    }
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), hash);
+    *accumulator |= quint32(_mm256_testz_si256(bits, bits) ? 0 : 1);
+}
+#endif
+
+#if defined(__SSE2__)
+static inline __m128i multiplyLow32(__m128i a, __m128i b)
+{
+    // _mm_mullo_epi32 needs SSE4.1, build it from the two 32x32->64 bit multiplications
+    const __m128i even = _mm_mul_epu32(a, b);
+    const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+static void hashBlocksSse2(const char *source, char *destination, int blockCount,
+                           quint32 *lanes, quint32 *accumulator)
+{
+    const __m128i prime = _mm_set1_epi32(int(hashPrime));
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes));
+    __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i *>(lanes + 4));
+    __m128i bits = _mm_setzero_si128();
+    for (int i = 0; i < blockCount; ++i) {
+        const auto in = reinterpret_cast<const __m128i *>(source + i * hashBlockSize);
+        const __m128i lowWords = _mm_loadu_si128(in);
+        const __m128i highWords = _mm_loadu_si128(in + 1);
+        if (destination) {
+            const auto out = reinterpret_cast<__m128i *>(destination + i * hashBlockSize);
+            _mm_storeu_si128(out, lowWords);
+            _mm_storeu_si128(out + 1, highWords);
+        }
+        bits = _mm_or_si128(bits, _mm_or_si128(lowWords, highWords));
+        low = multiplyLow32(_mm_xor_si128(low, lowWords), prime);
+        high = multiplyLow32(_mm_xor_si128(high, highWords), prime);
+    }
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes + 4), high);
+    const __m128i zero = _mm_cmpeq_epi8(bits, _mm_setzero_si128());
+    *accumulator |= quint32(_mm_movemask_epi8(zero) == 0xffff ? 0 : 1);
+}
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+static void hashBlocksNeon(const char *source, char *destination, int blockCount,
+                           quint32 *lanes, quint32 *accumulator)
+{
+    const uint32x4_t prime = vdupq_n_u32(hashPrime);
+    uint32x4_t low = vld1q_u32(lanes);
+    uint32x4_t high = vld1q_u32(lanes + 4);
+    uint32x4_t bits = vdupq_n_u32(0);
+    for (int i = 0; i < blockCount; ++i) {
+        const auto in = reinterpret_cast<const uint32_t *>(source + i * hashBlockSize);
+        const uint32x4_t lowWords = vreinterpretq_u32_u8(
+                    vld1q_u8(reinterpret_cast<const uint8_t *>(in)));
+        const uint32x4_t highWords = vreinterpretq_u32_u8(
+                    vld1q_u8(reinterpret_cast<const uint8_t *>(in + 4)));
+        if (destination) {
+            const auto out = reinterpret_cast<uint8_t *>(destination + i * hashBlockSize);
+            vst1q_u8(out, vreinterpretq_u8_u32(lowWords));
+            vst1q_u8(out + 16, vreinterpretq_u8_u32(highWords));
+        }
+        bits = vorrq_u32(bits, vorrq_u32(lowWords, highWords));
+        low = vmulq_u32(veorq_u32(low, lowWords), prime);
+        high = vmulq_u32(veorq_u32(high, highWords), prime);
+    }
+    vst1q_u32(lanes, low);
+    vst1q_u32(lanes + 4, high);
+    const uint32x2_t folded = vorr_u32(vget_low_u32(bits), vget_high_u32(bits));
+    *accumulator |= vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1);
+}
+#endif
+
+quint64 copyAndHash(const char *source, char *destination, int size, bool *isZero)
+{
+    quint32 lanes[hashLanes];
+    for (int lane = 0; lane < hashLanes; ++lane)
+        lanes[lane] = hashSeed + quint32(lane);
+    quint32 accumulator = 0;
+
+    const int blockCount = size / hashBlockSize;
+    int done = 0;
+#if defined(QT_COMPILER_SUPPORTS_AVX2)
+    if (qCpuHasFeature(AVX2)) {
+        hashBlocksAvx2(source, destination, blockCount, lanes, &accumulator);
+        done = blockCount;
+    }
+#endif
+    if (done < blockCount) {
+#if defined(__SSE2__)
+        hashBlocksSse2(source, destination, blockCount, lanes, &accumulator);
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+        hashBlocksNeon(source, destination, blockCount, lanes, &accumulator);
+#else
+        hashBlocksScalar(source, destination, blockCount, lanes, &accumulator);
+#endif
+        done = blockCount;
+    }
+
+    // Up to 31 trailing bytes, zero padded into one last block
+    const int offset = done * hashBlockSize;
+    const int tail = size - offset;
+    if (tail > 0) {
+        char block[hashBlockSize] = {};
+        std::memcpy(block, source + offset, tail);
+        if (destination)
+            std::memcpy(destination + offset, block, tail);
+        hashBlocksScalar(block, nullptr, 1, lanes, &accumulator);
+    }
+
+    *isZero = accumulator == 0;
+    quint64 hash = quint64(size);
+    for (int lane = 0; lane < hashLanes; ++lane) {
+        hash = (hash ^ lanes[lane]) * Q_UINT64_C(0x9e3779b97f4a7c15);
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+}
+
+QT_END_NAMESPACE
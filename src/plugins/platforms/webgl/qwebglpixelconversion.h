@@ -0,0 +1,65 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QWEBGLPIXELCONVERSION_H
+#define QWEBGLPIXELCONVERSION_H
+
+#include <QtCore/qglobal.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QWebGLPixelConversion
+{
+
+// All functions work on tightly packed pixels. Source and destination must not overlap.
+
+// BGRA8 -> RGBA8
+void swizzleBgraToRgba(const uchar *source, uchar *destination, int pixelCount);
+
+// BGRA32F -> RGBA32F
+void swizzleBgraToRgbaF(const float *source, float *destination, int pixelCount);
+
+// RGBA8 -> GL_UNSIGNED_SHORT_4_4_4_4
+void packRgba4444(const uchar *source, quint16 *destination, int pixelCount);
+
+// RGB8 -> GL_UNSIGNED_SHORT_5_6_5
+void packRgb565(const uchar *source, quint16 *destination, int pixelCount);
+
+// 32 bit float -> 16 bit half float (GL_HALF_FLOAT_OES)
+void floatToHalf(const float *source, quint16 *destination, int count);
+
+// Copies 'size' bytes to 'destination' unless it is null and returns a 64 bit hash of the
+// content, all in a single pass. 'isZero' is set to true if every byte is zero.
+quint64 copyAndHash(const char *source, char *destination, int size, bool *isZero);
+
+}
+
+QT_END_NAMESPACE
+
+#endif // QWEBGLPIXELCONVERSION_H
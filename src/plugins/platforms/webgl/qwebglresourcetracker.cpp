@@ -0,0 +1,557 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qwebglresourcetracker.h"
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qloggingcategory.h>
+
+QT_BEGIN_NAMESPACE
+
+static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.resourcetracker")
+
+// State setting calls, with the index of the parameter telling apart independent values (-1 if
+// the call sets a single value)
+static const QHash<QString, int> &stateFunctions()
+{
+    static const QHash<QString, int> functions {
+        { QStringLiteral("blendColor"), -1 },
+        { QStringLiteral("blendEquation"), -1 },
+        { QStringLiteral("blendEquationSeparate"), -1 },
+        { QStringLiteral("blendFunc"), -1 },
+        { QStringLiteral("blendFuncSeparate"), -1 },
+        { QStringLiteral("clearColor"), -1 },
+        { QStringLiteral("clearDepthf"), -1 },
+        { QStringLiteral("clearStencil"), -1 },
+        { QStringLiteral("colorMask"), -1 },
+        { QStringLiteral("cullFace"), -1 },
+        { QStringLiteral("depthFunc"), -1 },
+        { QStringLiteral("depthMask"), -1 },
+        { QStringLiteral("depthRangef"), -1 },
+        { QStringLiteral("frontFace"), -1 },
+        { QStringLiteral("hint"), 0 },
+        { QStringLiteral("lineWidth"), -1 },
+        { QStringLiteral("pixelStorei"), 0 },
+        { QStringLiteral("polygonOffset"), -1 },
+        { QStringLiteral("sampleCoverage"), -1 },
+        { QStringLiteral("scissor"), -1 },
+        { QStringLiteral("stencilFunc"), -1 },
+        { QStringLiteral("stencilFuncSeparate"), 0 },
+        { QStringLiteral("stencilMask"), -1 },
+        { QStringLiteral("stencilMaskSeparate"), 0 },
+        { QStringLiteral("stencilOp"), -1 },
+        { QStringLiteral("stencilOpSeparate"), 0 },
+        { QStringLiteral("viewport"), -1 },
+        { QStringLiteral("vertexAttrib1f"), 0 },
+        { QStringLiteral("vertexAttrib1fv"), 0 },
+        { QStringLiteral("vertexAttrib2f"), 0 },
+        { QStringLiteral("vertexAttrib2fv"), 0 },
+        { QStringLiteral("vertexAttrib3f"), 0 },
+        { QStringLiteral("vertexAttrib3fv"), 0 },
+        { QStringLiteral("vertexAttrib4f"), 0 },
+        { QStringLiteral("vertexAttrib4fv"), 0 }
+    };
+    return functions;
+}
+
+static uint uintAt(const QVariantList &parameters, int index)
+{
+    return index < parameters.size() ? parameters.at(index).toUInt() : 0u;
+}
+
+// Object names of the delete calls, given either as a list or as trailing parameters
+static QVector<uint> names(const QVariantList &parameters, int from)
+{
+    QVector<uint> result;
+    for (int i = from; i < parameters.size(); ++i) {
+        const auto &parameter = parameters.at(i);
+        if (parameter.type() == QVariant::List) {
+            for (const auto &value : parameter.toList())
+                result.append(value.toUInt());
+        } else {
+            result.append(parameter.toUInt());
+        }
+    }
+    return result;
+}
+
+// Small payloads live in the frame arena of the sending thread (see QWebGLFunctionCall::addData)
+// and are freed once sent, the tracker keeps its own copy.
+static QVariantList detached(const QVariantList &parameters)
+{
+    QVariantList result = parameters;
+    for (auto &parameter : result) {
+        if (parameter.type() == QVariant::ByteArray) {
+            const auto data = parameter.toByteArray();
+            parameter = QByteArray(data.constData(), data.size());
+        }
+    }
+    return result;
+}
+
+bool QWebGLResourceTracker::isEnabled()
+{
+    // Broadcast viewers joining a running session are brought up to date the same way
+    static const bool enabled = []() {
+        const auto resume = qgetenv("QT_WEBGL_RESUME");
+        const auto broadcast = qgetenv("QT_WEBGL_BROADCAST");
+        return (!resume.isEmpty() && resume != "0") || (!broadcast.isEmpty() && broadcast != "0");
+    }();
+    return enabled;
+}
+
+void QWebGLResourceTracker::record(const QString &function, const QVariantList &parameters,
+                                   int id)
+{
+    Command command { function, detached(parameters), {} };
+    if (function == QLatin1String("makeCurrent")) {
+        lastMakeCurrent = command;
+        currentContext = parameters.value(0).toInt();
+        if (currentContext)
+            contexts[currentContext].makeCurrent = command;
+        return;
+    }
+    if (!currentContext)
+        return;
+    auto &context = contexts[currentContext];
+
+    if (id != -1) {
+        // Creation -> name counter of the client
+        static const QHash<QString, QString> creations {
+            { QStringLiteral("createProgram"), QStringLiteral("nextProgramId") },
+            { QStringLiteral("createShader"), QStringLiteral("nextShaderId") },
+            { QStringLiteral("genBuffers"), QStringLiteral("nextBufferId") },
+            { QStringLiteral("genFramebuffers"), QStringLiteral("nextFramebufferId") },
+            { QStringLiteral("genRenderbuffers"), QStringLiteral("nextRenderBufferId") },
+            { QStringLiteral("genTextures"), QStringLiteral("nextTextureId") },
+            { QStringLiteral("getUniformLocation"), QStringLiteral("nextLocation") }
+        };
+        const auto it = creations.constFind(function);
+        if (it != creations.constEnd()) {
+            pendingCreations.insert(id, { currentContext, function, command.parameters });
+            const uint count = function.startsWith(QLatin1String("gen")) ? uintAt(parameters, 0)
+                                                                          : 1u;
+            context.nextNames[*it] = context.nextNames.value(*it, 1u).toUInt() + count;
+        }
+        return;
+    }
+
+    const auto removeMatching = [](CommandList &list, const QSet<QString> &functions,
+                                   int index, const QVariant &value) {
+        for (auto it = list.begin(); it != list.end();) {
+            if (functions.contains(it->function)
+                    && (index < 0 || it->parameters.value(index) == value)) {
+                it = list.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    };
+
+    if (function == QLatin1String("bindBuffer")) {
+        context.boundBuffers[uintAt(parameters, 0)] = uintAt(parameters, 1);
+    } else if (function == QLatin1String("bufferData")) {
+        const auto buffer = context.boundBuffers.value(uintAt(parameters, 0));
+        if (context.buffers.contains(buffer)) {
+            context.buffers[buffer] = { command };
+            context.bufferTargets[buffer] = uintAt(parameters, 0);
+        }
+    } else if (function == QLatin1String("bufferSubData")) {
+        const auto buffer = context.boundBuffers.value(uintAt(parameters, 0));
+        if (context.buffers.contains(buffer))
+            context.buffers[buffer].append(command);
+    } else if (function == QLatin1String("activeTexture")) {
+        context.activeTexture = uintAt(parameters, 0);
+    } else if (function == QLatin1String("bindTexture")) {
+        const auto target = uintAt(parameters, 0);
+        const auto texture = uintAt(parameters, 1);
+        context.boundTextures[qMakePair(context.activeTexture, target)] = texture;
+        if (context.textures.contains(texture))
+            context.textureTargets[texture] = target;
+    } else if (function.startsWith(QLatin1String("tex"))
+               || function.startsWith(QLatin1String("compressedTex"))
+               || function == QLatin1String("generateMipmap")) {
+        auto target = uintAt(parameters, 0);
+        if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X && target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z)
+            target = GL_TEXTURE_CUBE_MAP;
+        const auto texture = context.boundTextures.value(qMakePair(context.activeTexture,
+                                                                   target));
+        if (!context.textures.contains(texture))
+            return;
+        auto &commands = context.textures[texture];
+        if (function == QLatin1String("texImage2D")
+                || function == QLatin1String("texSubImage2D")) {
+            command.pixelStore = context.pixelStore; // the unpack state may change afterwards
+        }
+        if (function.startsWith(QLatin1String("texParameter"))) {
+            removeMatching(commands, { QStringLiteral("texParameterf"),
+                                       QStringLiteral("texParameteri") },
+                           1, parameters.value(1));
+        } else if ((function == QLatin1String("texImage2D")
+                    || function == QLatin1String("compressedTexImage2D"))
+                   && parameters.value(1).toInt() == 0) {
+            // A new base level replaces the previous contents of this face
+            removeMatching(commands, { QStringLiteral("texImage2D"),
+                                       QStringLiteral("texSubImage2D"),
+                                       QStringLiteral("compressedTexImage2D"),
+                                       QStringLiteral("compressedTexSubImage2D"),
+                                       QStringLiteral("copyTexImage2D"),
+                                       QStringLiteral("copyTexSubImage2D") },
+                           0, parameters.value(0));
+            removeMatching(commands, { QStringLiteral("generateMipmap") }, -1, QVariant());
+        }
+        commands.append(command);
+    } else if (function == QLatin1String("bindFramebuffer")) {
+        context.boundFramebuffer = uintAt(parameters, 1);
+    } else if (function == QLatin1String("framebufferTexture2D")
+               || function == QLatin1String("framebufferRenderbuffer")) {
+        if (!context.framebuffers.contains(context.boundFramebuffer))
+            return;
+        auto &commands = context.framebuffers[context.boundFramebuffer];
+        removeMatching(commands, { QStringLiteral("framebufferTexture2D"),
+                                   QStringLiteral("framebufferRenderbuffer") },
+                       1, parameters.value(1));
+        commands.append(command);
+    } else if (function == QLatin1String("bindRenderbuffer")) {
+        context.boundRenderbuffer = uintAt(parameters, 1);
+    } else if (function == QLatin1String("renderbufferStorage")) {
+        if (context.renderbuffers.contains(context.boundRenderbuffer))
+            context.renderbuffers[context.boundRenderbuffer] = { command };
+    } else if (function == QLatin1String("shaderSource")) {
+        if (context.shaders.contains(uintAt(parameters, 0)))
+            context.shaders[uintAt(parameters, 0)] = { command };
+    } else if (function == QLatin1String("compileShader")) {
+        if (context.shaders.contains(uintAt(parameters, 0)))
+            context.shaders[uintAt(parameters, 0)].append(command);
+    } else if (function == QLatin1String("attachShader")
+               || function == QLatin1String("detachShader")
+               || function == QLatin1String("bindAttribLocation")
+               || function == QLatin1String("linkProgram")) {
+        if (context.programs.contains(uintAt(parameters, 0)))
+            context.programs[uintAt(parameters, 0)].append(command);
+    } else if (function == QLatin1String("useProgram")) {
+        context.currentProgram = uintAt(parameters, 0);
+    } else if (function.startsWith(QLatin1String("uniform"))) {
+        const auto location = parameters.value(0).toInt();
+        if (context.uniformLocations.contains(location))
+            context.uniforms[location] = command;
+    } else if (function.startsWith(QLatin1String("delete"))) {
+        recordDeletion(context, function, parameters);
+    } else if (function == QLatin1String("pixelStorei")) {
+        context.pixelStore[uintAt(parameters, 0)] = parameters.value(1);
+        recordState(context, command);
+    } else {
+        recordState(context, command);
+    }
+}
+
+void QWebGLResourceTracker::recordDeletion(Context &context, const QString &function,
+                                           const QVariantList &parameters)
+{
+    if (function == QLatin1String("deleteBuffers")) {
+        for (auto buffer : names(parameters, 1)) {
+            context.buffers.remove(buffer);
+            context.bufferTargets.remove(buffer);
+        }
+    } else if (function == QLatin1String("deleteTextures")) {
+        for (auto texture : names(parameters, 0)) {
+            context.textures.remove(texture);
+            context.textureTargets.remove(texture);
+            // Deleting a bound texture unbinds it
+            for (auto it = context.boundTextures.begin(); it != context.boundTextures.end();) {
+                if (*it == texture)
+                    it = context.boundTextures.erase(it);
+                else
+                    ++it;
+            }
+        }
+    } else if (function == QLatin1String("deleteFramebuffers")) {
+        for (auto framebuffer : names(parameters, 0))
+            context.framebuffers.remove(framebuffer);
+    } else if (function == QLatin1String("deleteRenderbuffers")) {
+        for (auto renderbuffer : names(parameters, 0))
+            context.renderbuffers.remove(renderbuffer);
+    } else if (function == QLatin1String("deleteProgram")) {
+        const auto program = uintAt(parameters, 0);
+        context.programs.remove(program);
+        for (auto it = context.uniformLocations.begin(); it != context.uniformLocations.end();) {
+            if (it->program == program) {
+                context.uniforms.remove(it.key());
+                it = context.uniformLocations.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        pruneShaders(context);
+    } else if (function == QLatin1String("deleteShader")) {
+        // Programs linked with the shader need it for the replay, it is deleted afterwards
+        context.deletedShaders.insert(uintAt(parameters, 0));
+        pruneShaders(context);
+    }
+}
+
+// Forgets the deleted shaders no program attaches anymore. A shader detached after the link is
+// kept as long as the program lives, since replaying the program attaches it again.
+void QWebGLResourceTracker::pruneShaders(Context &context)
+{
+    QSet<uint> attached;
+    for (const auto &commands : qAsConst(context.programs)) {
+        for (const auto &command : commands) {
+            if (command.function == QLatin1String("attachShader"))
+                attached.insert(uintAt(command.parameters, 1));
+        }
+    }
+    for (auto it = context.deletedShaders.begin(); it != context.deletedShaders.end();) {
+        if (attached.contains(*it)) {
+            ++it;
+        } else {
+            context.shaders.remove(*it);
+            context.shaderTypes.remove(*it);
+            it = context.deletedShaders.erase(it);
+        }
+    }
+}
+
+void QWebGLResourceTracker::recordState(Context &context, const Command &command)
+{
+    const auto &parameters = command.parameters;
+    if (command.function == QLatin1String("enable")
+            || command.function == QLatin1String("disable")) {
+        context.state[QStringLiteral("capability ") + parameters.value(0).toString()] = { command };
+    } else if (command.function == QLatin1String("enableVertexAttribArray")
+               || command.function == QLatin1String("disableVertexAttribArray")) {
+        context.state[QStringLiteral("array ") + parameters.value(0).toString()] = { command };
+    } else if (command.function == QLatin1String("vertexAttribPointer")) {
+        // The pointer refers to the array buffer bound at the time of the call
+        const Command bind { QStringLiteral("bindBuffer"),
+                             { GL_ARRAY_BUFFER, context.boundBuffers.value(GL_ARRAY_BUFFER) } };
+        context.state[QStringLiteral("pointer ") + parameters.value(0).toString()] = {
+            bind, command
+        };
+    } else {
+        const auto it = stateFunctions().constFind(command.function);
+        if (it == stateFunctions().constEnd())
+            return;
+        auto key = command.function;
+        if (*it >= 0)
+            key += QLatin1Char(' ') + parameters.value(*it).toString();
+        context.state[key] = { command };
+    }
+}
+
+void QWebGLResourceTracker::recordResponse(int id, const QVariant &value)
+{
+    const auto it = pendingCreations.find(id);
+    if (it == pendingCreations.end())
+        return;
+    const auto creation = *it;
+    pendingCreations.erase(it);
+    if (value.isNull() || !contexts.contains(creation.context))
+        return;
+    auto &context = contexts[creation.context];
+    const auto &function = creation.function;
+    if (function == QLatin1String("createProgram")) {
+        context.programs.insert(value.toUInt(), {});
+    } else if (function == QLatin1String("createShader")) {
+        context.shaders.insert(value.toUInt(), {});
+        context.shaderTypes.insert(value.toUInt(), creation.parameters.value(0).toUInt());
+    } else if (function == QLatin1String("getUniformLocation")) {
+        if (value.toInt() != -1) {
+            context.uniformLocations.insert(value.toInt(),
+                                            { creation.parameters.value(0).toUInt(),
+                                              creation.parameters.value(1).toString() });
+        }
+    } else {
+        QMap<uint, CommandList> *objects = nullptr;
+        if (function == QLatin1String("genBuffers"))
+            objects = &context.buffers;
+        else if (function == QLatin1String("genTextures"))
+            objects = &context.textures;
+        else if (function == QLatin1String("genFramebuffers"))
+            objects = &context.framebuffers;
+        else if (function == QLatin1String("genRenderbuffers"))
+            objects = &context.renderbuffers;
+        Q_ASSERT(objects);
+        for (const auto &name : value.toList())
+            objects->insert(name.toUInt(), {});
+    }
+}
+
+void QWebGLResourceTracker::cancelCreations()
+{
+    pendingCreations.clear();
+}
+
+void QWebGLResourceTracker::replay(const Sender &send)
+{
+    for (auto it = contexts.cbegin(), end = contexts.cend(); it != end; ++it) {
+        if (!it->makeCurrent.function.isEmpty())
+            replayContext(*it, send);
+    }
+    if (!lastMakeCurrent.function.isEmpty()) {
+        send(QWebGLWebSocketServer::MessageType::GlCommand,
+             { { "function", lastMakeCurrent.function },
+               { "parameters", lastMakeCurrent.parameters } });
+    }
+}
+
+void QWebGLResourceTracker::replayContext(const Context &context, const Sender &send)
+{
+    // Uploads are replayed with the pixelStorei values they were made with, values set only
+    // later are reset to their defaults. The current values are replayed with the state.
+    PixelStore pixelStore;
+    const auto sendPixelStore = [&send, &pixelStore](const PixelStore &values) {
+        const auto defaultValue = [](uint name) {
+            return QVariant(name == GL_PACK_ALIGNMENT || name == GL_UNPACK_ALIGNMENT ? 4 : 0);
+        };
+        auto changed = values.keys();
+        for (auto it = pixelStore.cbegin(), end = pixelStore.cend(); it != end; ++it) {
+            if (!values.contains(it.key()))
+                changed.append(it.key());
+        }
+        for (auto name : qAsConst(changed)) {
+            const auto value = values.value(name, defaultValue(name));
+            if (pixelStore.value(name, defaultValue(name)) == value)
+                continue;
+            pixelStore[name] = value;
+            send(QWebGLWebSocketServer::MessageType::GlCommand,
+                 { { "function", QStringLiteral("pixelStorei") },
+                   { "parameters", QVariantList { name, value } } });
+        }
+    };
+    const auto sendCommand = [&send, &sendPixelStore](const Command &command) {
+        if (command.function == QLatin1String("texImage2D")
+                || command.function == QLatin1String("texSubImage2D")) {
+            sendPixelStore(command.pixelStore);
+        }
+        send(QWebGLWebSocketServer::MessageType::GlCommand,
+             { { "function", command.function }, { "parameters", command.parameters } });
+    };
+    const auto sendCommands = [&sendCommand](const CommandList &commands) {
+        for (const auto &command : commands)
+            sendCommand(command);
+    };
+    const auto keys = [](const QMap<uint, CommandList> &objects) {
+        QVariantList result;
+        for (auto it = objects.cbegin(), end = objects.cend(); it != end; ++it)
+            result.append(it.key());
+        return result;
+    };
+
+    sendCommand(context.makeCurrent);
+    const auto contextId = context.makeCurrent.parameters.value(0);
+    qCDebug(lc, "Replaying context %d: %d buffers, %d textures, %d programs",
+            contextId.toInt(), context.buffers.size(), context.textures.size(),
+            context.programs.size());
+
+    // Recreates the objects with their original names
+    QVariantList shaders;
+    for (auto it = context.shaders.cbegin(), end = context.shaders.cend(); it != end; ++it)
+        shaders.append(QVariantList { it.key(), context.shaderTypes.value(it.key()) });
+    send(QWebGLWebSocketServer::MessageType::RestoreContext, {
+             { "context", contextId },
+             { "buffers", keys(context.buffers) },
+             { "textures", keys(context.textures) },
+             { "framebuffers", keys(context.framebuffers) },
+             { "renderbuffers", keys(context.renderbuffers) },
+             { "programs", keys(context.programs) },
+             { "shaders", shaders },
+             { "nextNames", context.nextNames }
+         });
+
+    for (auto it = context.buffers.cbegin(), end = context.buffers.cend(); it != end; ++it) {
+        if (it->isEmpty())
+            continue;
+        sendCommand({ QStringLiteral("bindBuffer"),
+                      { context.bufferTargets.value(it.key()), it.key() } });
+        sendCommands(*it);
+    }
+    sendCommand({ QStringLiteral("activeTexture"), { GL_TEXTURE0 } });
+    for (auto it = context.textures.cbegin(), end = context.textures.cend(); it != end; ++it) {
+        if (it->isEmpty())
+            continue;
+        sendCommand({ QStringLiteral("bindTexture"),
+                      { context.textureTargets.value(it.key(), GL_TEXTURE_2D), it.key() } });
+        sendCommands(*it);
+    }
+    for (auto it = context.renderbuffers.cbegin(), end = context.renderbuffers.cend();
+         it != end; ++it) {
+        sendCommand({ QStringLiteral("bindRenderbuffer"), { GL_RENDERBUFFER, it.key() } });
+        sendCommands(*it);
+    }
+    for (auto it = context.framebuffers.cbegin(), end = context.framebuffers.cend();
+         it != end; ++it) {
+        sendCommand({ QStringLiteral("bindFramebuffer"), { GL_FRAMEBUFFER, it.key() } });
+        sendCommands(*it);
+    }
+    for (const auto &commands : context.shaders)
+        sendCommands(commands);
+    for (const auto &commands : context.programs)
+        sendCommands(commands);
+    for (auto shader : context.deletedShaders) {
+        if (context.shaders.contains(shader))
+            sendCommand({ QStringLiteral("deleteShader"), { shader } });
+    }
+
+    // Uniform locations are resolved once the programs are linked
+    QVariantList locations;
+    for (auto it = context.uniformLocations.cbegin(), end = context.uniformLocations.cend();
+         it != end; ++it) {
+        locations.append(QVariantList { it.key(), it->program, it->name });
+    }
+    send(QWebGLWebSocketServer::MessageType::RestoreContext, {
+             { "context", contextId },
+             { "uniformLocations", locations }
+         });
+    for (auto it = context.uniforms.cbegin(), end = context.uniforms.cend(); it != end; ++it) {
+        sendCommand({ QStringLiteral("useProgram"),
+                      { context.uniformLocations.value(it.key()).program } });
+        sendCommand(*it);
+    }
+
+    for (const auto &commands : context.state)
+        sendCommands(commands);
+    for (auto it = context.boundTextures.cbegin(), end = context.boundTextures.cend();
+         it != end; ++it) {
+        sendCommand({ QStringLiteral("activeTexture"), { it.key().first } });
+        sendCommand({ QStringLiteral("bindTexture"), { it.key().second, *it } });
+    }
+    sendCommand({ QStringLiteral("activeTexture"), { context.activeTexture } });
+    for (auto it = context.boundBuffers.cbegin(), end = context.boundBuffers.cend(); it != end;
+         ++it) {
+        sendCommand({ QStringLiteral("bindBuffer"), { it.key(), *it } });
+    }
+    sendCommand({ QStringLiteral("bindFramebuffer"),
+                  { GL_FRAMEBUFFER, context.boundFramebuffer } });
+    sendCommand({ QStringLiteral("bindRenderbuffer"),
+                  { GL_RENDERBUFFER, context.boundRenderbuffer } });
+    sendCommand({ QStringLiteral("useProgram"), { context.currentProgram } });
+}
+
+QT_END_NAMESPACE
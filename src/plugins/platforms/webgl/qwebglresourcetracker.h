@@ -0,0 +1,133 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QWEBGLRESOURCETRACKER_H
+#define QWEBGLRESOURCETRACKER_H
+
+#include "qwebglwebsocketserver.h"
+
+#include <QtCore/qhash.h>
+#include <QtCore/qmap.h>
+#include <QtCore/qpair.h>
+#include <QtCore/qset.h>
+#include <QtCore/qstring.h>
+#include <QtCore/qvariant.h>
+#include <QtCore/qvector.h>
+#include <QtGui/qopengl.h>
+
+#include <functional>
+
+QT_BEGIN_NAMESPACE
+
+// Keeps the live GL resources and the current state of every context, as seen in the stream of
+// gl_commands, so that a reconnecting client can be brought up to date without the help of the
+// application. Only used by the WebSocket thread.
+class QWebGLResourceTracker
+{
+public:
+    // Enabled with QT_WEBGL_RESUME or QT_WEBGL_BROADCAST
+    static bool isEnabled();
+
+    void record(const QString &function, const QVariantList &parameters, int id);
+    void recordResponse(int id, const QVariant &value);
+    // The client answering the creations is gone, their responses will never arrive
+    void cancelCreations();
+
+    using Sender = std::function<void(QWebGLWebSocketServer::MessageType, const QVariantMap &)>;
+    void replay(const Sender &send);
+
+private:
+    using PixelStore = QMap<uint, QVariant>; // pixelStorei values set so far, by name
+
+    struct Command
+    {
+        QString function;
+        QVariantList parameters;
+        PixelStore pixelStore; // in effect for a texture upload
+    };
+    using CommandList = QVector<Command>;
+
+    struct UniformLocation
+    {
+        uint program;
+        QString name;
+    };
+
+    struct Context
+    {
+        Command makeCurrent;
+
+        QMap<uint, CommandList> buffers;
+        QHash<uint, uint> bufferTargets;
+        QMap<uint, CommandList> textures;
+        QHash<uint, uint> textureTargets;
+        QMap<uint, CommandList> framebuffers;
+        QMap<uint, CommandList> renderbuffers;
+        QMap<uint, CommandList> shaders;
+        QHash<uint, uint> shaderTypes;
+        QSet<uint> deletedShaders; // still needed by the replay of a program
+        QMap<uint, CommandList> programs;
+        QMap<int, UniformLocation> uniformLocations;
+        QMap<int, Command> uniforms; // last value per location
+        // Name counters of the client (see webqt.jsx), advanced by the calls sent. Viewers and
+        // resumed clients continue from them and allocate the same names as the first client.
+        QVariantMap nextNames;
+
+        QMap<QString, CommandList> state; // last call per state key
+        PixelStore pixelStore;
+        QHash<uint, uint> boundBuffers;
+        QMap<QPair<uint, uint>, uint> boundTextures; // (unit, target) -> texture
+        uint activeTexture = GL_TEXTURE0;
+        uint boundFramebuffer = 0;
+        uint boundRenderbuffer = 0;
+        uint currentProgram = 0;
+    };
+
+    struct PendingCreation
+    {
+        int context;
+        QString function;
+        QVariantList parameters;
+    };
+
+    void recordDeletion(Context &context, const QString &function,
+                        const QVariantList &parameters);
+    void recordState(Context &context, const Command &command);
+    static void pruneShaders(Context &context);
+    static void replayContext(const Context &context, const Sender &send);
+
+    QHash<int, Context> contexts;
+    QHash<int, PendingCreation> pendingCreations;
+    Command lastMakeCurrent;
+    int currentContext = 0;
+};
+
+QT_END_NAMESPACE
+
+#endif // QWEBGLRESOURCETRACKER_H
@@ -0,0 +1,429 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qwebglsessionmanager.h"
+
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qhash.h>
+#include <QtCore/qloggingcategory.h>
+#include <QtCore/qprocess.h>
+#include <QtCore/qtimer.h>
+#include <QtCore/quuid.h>
+#include <QtNetwork/qlocalserver.h>
+#include <QtNetwork/qlocalsocket.h>
+#include <QtNetwork/qtcpserver.h>
+#include <QtNetwork/qtcpsocket.h>
+
+QT_BEGIN_NAMESPACE
+
+static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.sessionmanager")
+
+// Requests are routed by their head only, anything bigger is not a request we serve
+static const int maxHeadSize = 16 * 1024;
+static const QByteArray cookieName = QByteArrayLiteral("qtwebglsession");
+// A session whose page never opens the WebSocket goes back to the pool after this time (ms)
+static const int unconnectedSessionTimeout = 30000;
+// Delays before replacing idle workers that died, doubled for every death in a row (ms)
+static const int minRespawnDelay = 1000;
+static const int maxRespawnDelay = 60000;
+// A proxied connection reads no further while this much is waiting to be sent to the other end
+static const qint64 maxRelayBacklog = 64 * 1024;
+
+struct Worker
+{
+    QProcess *process = nullptr;
+    QLocalSocket *control = nullptr;
+    quint16 httpPort = 0;
+    quint16 webSocketPort = 0;
+    QByteArray session;
+    bool webSocketConnected = false;
+
+    bool isReady() const { return control && httpPort && webSocketPort; }
+};
+
+class QWebGLSessionManagerPrivate
+{
+public:
+    void fillPool();
+    void spawnWorker();
+    void scheduleRespawn();
+    Worker *takeIdleWorker();
+    void reclaimSession(const QByteArray &session);
+    void route(QTcpSocket *socket, const QByteArray &head, bool isWebSocket);
+    static void proxy(QTcpSocket *client, const QByteArray &head, quint16 port);
+    static QByteArray sessionCookie(const QByteArray &head);
+
+    QWebGLSessionManager *q_ptr = nullptr;
+    int poolSize = 0;
+    int maxWorkers = 0;
+    int respawnDelay = 0;
+    bool respawnPending = false;
+    QTcpServer httpServer;
+    QTcpServer webSocketServer;
+    QLocalServer controlServer;
+    QList<Worker *> workers;
+    QHash<QByteArray, Worker *> sessions;
+    QHash<QTcpSocket *, QByteArray> heads;
+};
+
+void QWebGLSessionManagerPrivate::fillPool()
+{
+    if (respawnPending)
+        return;
+    int idle = 0;
+    for (auto worker : qAsConst(workers))
+        if (worker->session.isEmpty())
+            ++idle;
+    for (; idle < poolSize && workers.size() < maxWorkers; ++idle)
+        spawnWorker();
+}
+
+void QWebGLSessionManagerPrivate::spawnWorker()
+{
+    auto worker = new Worker;
+    worker->process = new QProcess(q_ptr);
+    auto environment = QProcessEnvironment::systemEnvironment();
+    environment.insert(QStringLiteral("QT_QPA_PLATFORM"), QStringLiteral("webgl"));
+    environment.remove(QStringLiteral("QT_WEBGL_LOCAL_SOCKET")); // The manager owns the listener
+    environment.insert(QStringLiteral("QT_WEBGL_SESSION_MANAGER"), controlServer.fullServerName());
+    environment.insert(QStringLiteral("QT_WEBGL_PUBLIC_WEBSOCKET_PORT"),
+                       QString::number(webSocketServer.serverPort()));
+    worker->process->setProcessEnvironment(environment);
+    worker->process->setProcessChannelMode(QProcess::ForwardedChannels);
+    QObject::connect(worker->process,
+                     QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished),
+                     q_ptr, [this, worker]()
+    {
+        qCDebug(lc, "Worker %lld finished", worker->process->processId());
+        workers.removeOne(worker);
+        sessions.remove(worker->session);
+        worker->process->deleteLater();
+        if (worker->control)
+            worker->control->deleteLater();
+        const bool wasIdle = worker->session.isEmpty();
+        delete worker;
+        // A worker that dies before serving anyone must not respawn in a loop
+        if (wasIdle)
+            scheduleRespawn();
+        else
+            fillPool();
+    });
+    workers.append(worker);
+    worker->process->start(QCoreApplication::applicationFilePath(),
+                           QCoreApplication::arguments().mid(1));
+    qCDebug(lc, "Started worker %lld", worker->process->processId());
+}
+
+void QWebGLSessionManagerPrivate::scheduleRespawn()
+{
+    if (respawnPending)
+        return;
+    respawnPending = true;
+    respawnDelay = respawnDelay ? qMin(respawnDelay * 2, maxRespawnDelay) : minRespawnDelay;
+    qCWarning(lc, "Idle worker died, refilling the pool in %d ms", respawnDelay);
+    QTimer::singleShot(respawnDelay, q_ptr, [this]()
+    {
+        respawnPending = false;
+        fillPool();
+    });
+}
+
+Worker *QWebGLSessionManagerPrivate::takeIdleWorker()
+{
+    for (auto worker : qAsConst(workers)) {
+        if (worker->session.isEmpty() && worker->isReady()) {
+            worker->session = QUuid::createUuid().toByteArray(QUuid::Id128);
+            sessions.insert(worker->session, worker);
+            const auto session = worker->session;
+            QTimer::singleShot(unconnectedSessionTimeout, q_ptr, [this, session]()
+            {
+                reclaimSession(session);
+            });
+            return worker;
+        }
+    }
+    return nullptr;
+}
+
+void QWebGLSessionManagerPrivate::reclaimSession(const QByteArray &session)
+{
+    // The worker has not served a client yet, it can take the next session
+    const auto worker = sessions.value(session);
+    if (!worker || worker->webSocketConnected)
+        return;
+    qCDebug(lc, "Session %s never connected, worker %lld back to the pool",
+            session.constData(), worker->process->processId());
+    sessions.remove(session);
+    worker->session.clear();
+}
+
+void QWebGLSessionManagerPrivate::route(QTcpSocket *socket, const QByteArray &head,
+                                        bool isWebSocket)
+{
+    const auto worker = sessions.value(sessionCookie(head));
+    if (worker && worker->isReady()) {
+        if (isWebSocket)
+            worker->webSocketConnected = true;
+        proxy(socket, head, isWebSocket ? worker->webSocketPort : worker->httpPort);
+        return;
+    }
+
+    QByteArray answer;
+    if (isWebSocket) {
+        answer = QByteArrayLiteral("HTTP/1.1 403 Forbidden\r\n");
+    } else if (const auto idleWorker = takeIdleWorker()) {
+        qCDebug(lc, "Session %s assigned to worker %lld", idleWorker->session.constData(),
+                idleWorker->process->processId());
+        fillPool();
+        // The browser sends the cookie along to every port of the host, the WebSocket included
+        const auto requestLine = head.left(head.indexOf("\r\n")).split(' ');
+        const auto location = requestLine.size() > 1 ? requestLine.at(1) : QByteArray("/");
+        answer = QByteArrayLiteral("HTTP/1.1 302 Found\r\n"
+                                   "Location: ") + location + QByteArrayLiteral("\r\n"
+                                   "Set-Cookie: ") + cookieName + '=' + idleWorker->session +
+                 QByteArrayLiteral("; Path=/; HttpOnly\r\n");
+    } else {
+        answer = QByteArrayLiteral("HTTP/1.1 503 Service Unavailable\r\n"
+                                   "Retry-After: 1\r\n");
+    }
+    socket->write(answer + QByteArrayLiteral("Content-Length: 0\r\n"
+                                             "Connection: close\r\n\r\n"));
+    socket->disconnectFromHost();
+}
+
+static void relay(QTcpSocket *source, QTcpSocket *destination)
+{
+    // Data is forwarded as soon as the source has it, but stays in the source while the other
+    // end has not received the previous data. The bounded read buffer of the source leaves the
+    // rest in the kernel, where TCP flow control slows the sender down.
+    const auto forward = [source, destination]()
+    {
+        while (destination->bytesToWrite() < maxRelayBacklog && source->bytesAvailable() > 0)
+            destination->write(source->read(maxRelayBacklog));
+    };
+    QObject::connect(source, &QIODevice::readyRead, destination, forward);
+    QObject::connect(destination, &QIODevice::bytesWritten, source, forward);
+    forward();
+}
+
+void QWebGLSessionManagerPrivate::proxy(QTcpSocket *client, const QByteArray &head, quint16 port)
+{
+    auto upstream = new QTcpSocket(client);
+    client->setReadBufferSize(maxRelayBacklog);
+    upstream->setReadBufferSize(maxRelayBacklog);
+    QObject::connect(upstream, &QTcpSocket::connected, client, [client, upstream, head]()
+    {
+        upstream->write(head);
+        relay(client, upstream);
+    });
+    relay(upstream, client);
+    // What is still held back by the relay is sent before the other end is closed
+    QObject::connect(upstream, &QTcpSocket::stateChanged, client,
+                     [client, upstream](QAbstractSocket::SocketState state)
+    {
+        if (state != QAbstractSocket::UnconnectedState)
+            return;
+        if (client->state() == QAbstractSocket::ConnectedState)
+            client->write(upstream->readAll());
+        client->disconnectFromHost();
+    });
+    QObject::connect(client, &QTcpSocket::disconnected, upstream, [client, upstream]()
+    {
+        if (upstream->state() == QAbstractSocket::ConnectedState)
+            upstream->write(client->readAll());
+        upstream->disconnectFromHost();
+    });
+    upstream->connectToHost(QHostAddress::LocalHost, port);
+}
+
+QByteArray QWebGLSessionManagerPrivate::sessionCookie(const QByteArray &head)
+{
+    const auto lines = head.split('\n');
+    for (const auto &line : lines) {
+        const int colon = line.indexOf(':');
+        if (colon == -1 || line.left(colon).trimmed().toLower() != "cookie")
+            continue;
+        const auto cookies = line.mid(colon + 1).split(';');
+        for (const auto &cookie : cookies) {
+            const auto pair = cookie.trimmed();
+            if (pair.startsWith(cookieName + '='))
+                return pair.mid(cookieName.size() + 1);
+        }
+    }
+    return QByteArray();
+}
+
+QWebGLSessionManager::QWebGLSessionManager(int poolSize, QObject *parent) :
+    QObject(parent),
+    d_ptr(new QWebGLSessionManagerPrivate)
+{
+    Q_D(QWebGLSessionManager);
+    d->q_ptr = this;
+    d->poolSize = poolSize;
+    d->maxWorkers = qMax(poolSize, maxWorkers());
+    connect(&d->httpServer, &QTcpServer::newConnection,
+            this, &QWebGLSessionManager::clientConnected);
+    connect(&d->webSocketServer, &QTcpServer::newConnection,
+            this, &QWebGLSessionManager::clientConnected);
+    connect(&d->controlServer, &QLocalServer::newConnection,
+            this, &QWebGLSessionManager::workerConnected);
+}
+
+QWebGLSessionManager::~QWebGLSessionManager()
+{
+    Q_D(QWebGLSessionManager);
+    for (auto worker : qAsConst(d->workers)) {
+        worker->process->disconnect(this);
+        worker->process->terminate();
+        if (!worker->process->waitForFinished(1000))
+            worker->process->kill();
+        delete worker;
+    }
+}
+
+bool QWebGLSessionManager::listen(const QHostAddress &address, quint16 httpPort,
+                                  quint16 webSocketPort)
+{
+    Q_D(QWebGLSessionManager);
+    const auto name = QStringLiteral("qtwebgl-%1").arg(QCoreApplication::applicationPid());
+    QLocalServer::removeServer(name);
+    if (!d->controlServer.listen(name) || !d->httpServer.listen(address, httpPort)
+            || !d->webSocketServer.listen(address, webSocketPort)) {
+        return false;
+    }
+    qCDebug(lc, "Serving sessions on ports %d and %d with %d pre-started workers",
+            d->httpServer.serverPort(), d->webSocketServer.serverPort(), d->poolSize);
+    d->fillPool();
+    return true;
+}
+
+QString QWebGLSessionManager::errorString() const
+{
+    Q_D(const QWebGLSessionManager);
+    if (!d->controlServer.errorString().isEmpty())
+        return d->controlServer.errorString();
+    if (!d->httpServer.errorString().isEmpty())
+        return d->httpServer.errorString();
+    return d->webSocketServer.errorString();
+}
+
+int QWebGLSessionManager::poolSize()
+{
+    return isWorker() ? 0 : qEnvironmentVariableIntValue("QT_WEBGL_SESSIONS");
+}
+
+int QWebGLSessionManager::maxWorkers()
+{
+    // Busy and idle workers together, sessions beyond it are answered with 503
+    bool ok;
+    const int value = qEnvironmentVariableIntValue("QT_WEBGL_MAX_WORKERS", &ok);
+    return ok && value > 0 ? value : 64;
+}
+
+bool QWebGLSessionManager::isWorker()
+{
+    return qEnvironmentVariableIsSet("QT_WEBGL_SESSION_MANAGER");
+}
+
+void QWebGLSessionManager::registerWorker(quint16 httpPort, quint16 webSocketPort,
+                                          QObject *parent)
+{
+    auto socket = new QLocalSocket(parent);
+    // A worker without its manager can not be reached anymore
+    connect(socket, &QLocalSocket::disconnected, QCoreApplication::instance(),
+            &QCoreApplication::quit, Qt::QueuedConnection);
+    socket->connectToServer(qEnvironmentVariable("QT_WEBGL_SESSION_MANAGER"));
+    if (!socket->waitForConnected(5000)) {
+        qFatal("QWebGLSessionManager::registerWorker: Failed to reach the session manager: %s",
+               qPrintable(socket->errorString()));
+    }
+    socket->write(QByteArray::number(QCoreApplication::applicationPid()) + ' ' +
+                  QByteArray::number(httpPort) + ' ' + QByteArray::number(webSocketPort) + '\n');
+    socket->flush();
+}
+
+void QWebGLSessionManager::clientConnected()
+{
+    Q_D(QWebGLSessionManager);
+    auto server = qobject_cast<QTcpServer *>(sender());
+    Q_ASSERT(server);
+    const bool isWebSocket = server == &d->webSocketServer;
+    while (auto socket = server->nextPendingConnection()) {
+        d->heads.insert(socket, QByteArray());
+        connect(socket, &QTcpSocket::disconnected, this, [d, socket]()
+        {
+            d->heads.remove(socket);
+            socket->deleteLater();
+        });
+        connect(socket, &QTcpSocket::readyRead, this, [d, socket, isWebSocket]()
+        {
+            const auto it = d->heads.find(socket);
+            if (it == d->heads.end())
+                return; // Already routed
+            *it += socket->read(maxHeadSize + 1 - it->size());
+            if (it->indexOf("\r\n\r\n") == -1) {
+                if (it->size() > maxHeadSize) {
+                    d->heads.erase(it);
+                    socket->abort();
+                }
+                return;
+            }
+            d->route(socket, d->heads.take(socket), isWebSocket);
+        });
+    }
+}
+
+void QWebGLSessionManager::workerConnected()
+{
+    Q_D(QWebGLSessionManager);
+    while (auto socket = d->controlServer.nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, [d, socket]()
+        {
+            if (!socket->canReadLine())
+                return;
+            const auto fields = socket->readLine().trimmed().split(' ');
+            if (fields.size() != 3)
+                return;
+            for (auto worker : qAsConst(d->workers)) {
+                if (worker->process->processId() == fields.at(0).toLongLong()) {
+                    worker->control = socket;
+                    worker->httpPort = fields.at(1).toUShort();
+                    worker->webSocketPort = fields.at(2).toUShort();
+                    d->respawnDelay = 0; // workers start fine again
+                    qCDebug(lc, "Worker %lld ready", worker->process->processId());
+                    return;
+                }
+            }
+            qCWarning(lc, "Unknown worker connected");
+            socket->disconnectFromServer();
+        });
+    }
+}
+
+QT_END_NAMESPACE
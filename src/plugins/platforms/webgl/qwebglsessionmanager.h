@@ -0,0 +1,69 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QWEBGLSESSIONMANAGER_H
+#define QWEBGLSESSIONMANAGER_H
+
+#include <QtCore/qobject.h>
+#include <QtCore/qscopedpointer.h>
+#include <QtNetwork/qhostaddress.h>
+
+QT_BEGIN_NAMESPACE
+
+class QWebGLSessionManagerPrivate;
+
+class QWebGLSessionManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit QWebGLSessionManager(int poolSize, QObject *parent = nullptr);
+    ~QWebGLSessionManager() override;
+
+    bool listen(const QHostAddress &address, quint16 httpPort, quint16 webSocketPort);
+    QString errorString() const;
+
+    static int poolSize();
+    static int maxWorkers();
+    static bool isWorker();
+    static void registerWorker(quint16 httpPort, quint16 webSocketPort, QObject *parent);
+
+private slots:
+    void clientConnected();
+    void workerConnected();
+
+private:
+    Q_DISABLE_COPY(QWebGLSessionManager)
+    Q_DECLARE_PRIVATE(QWebGLSessionManager)
+    QScopedPointer<QWebGLSessionManagerPrivate> d_ptr;
+};
+
+QT_END_NAMESPACE
+
+#endif // QWEBGLSESSIONMANAGER_H
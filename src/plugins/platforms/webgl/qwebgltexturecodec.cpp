@@ -0,0 +1,139 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qwebgltexturecodec.h"
+
+#include <QtCore/qbuffer.h>
+#include <QtCore/qloggingcategory.h>
+#include <QtGui/qimage.h>
+#include <QtGui/qimagewriter.h>
+
+QT_BEGIN_NAMESPACE
+
+static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.texturecodec")
+
+namespace QWebGLTextureCodec
+{
+
+// Encoding small textures is not worth the CPU time and the extra decoding round in the browser
+static const int minimumPixelCount = 64 * 64;
+
+Policy policy()
+{
+    static const Policy policy = []() {
+        const auto value = qgetenv("QT_WEBGL_TEXTURE_CODEC").toLower();
+        if (value == "lossless" || value == "png")
+            return Policy::Lossless;
+        if (value == "lossy")
+            return Policy::Lossy;
+        if (!value.isEmpty() && value != "none")
+            qCWarning(lc, "Unknown texture codec policy: %s", value.constData());
+        return Policy::None;
+    }();
+    return policy;
+}
+
+int quality()
+{
+    static const int quality = []() {
+        bool ok;
+        const int value = qgetenv("QT_WEBGL_TEXTURE_QUALITY").toInt(&ok);
+        return ok ? qBound(1, value, 100) : 85;
+    }();
+    return quality;
+}
+
+static bool isOpaque(const uchar *pixels, int size)
+{
+    for (int i = 3; i < size; i += 4) {
+        if (pixels[i] != 0xff)
+            return false;
+    }
+    return true;
+}
+
+static QByteArray lossyFormat()
+{
+    static const QByteArray format = QImageWriter::supportedImageFormats().contains("webp")
+            ? QByteArrayLiteral("webp") : QByteArrayLiteral("jpeg");
+    return format;
+}
+
+bool encode(GLenum format, GLenum type, GLsizei width, GLsizei height, int unpackAlignment,
+            const char *pixels, int size, bool allowLossy, EncodedImage *result)
+{
+    const auto currentPolicy = policy();
+    if (currentPolicy == Policy::None || !pixels || type != GL_UNSIGNED_BYTE)
+        return false;
+    if (format != GL_RGBA && format != GL_RGB)
+        return false;
+    if (width * height < minimumPixelCount)
+        return false;
+
+    const int bytesPerPixel = format == GL_RGBA ? 4 : 3;
+    const int rowSize = width * bytesPerPixel;
+    // imageSize() does not account for row padding, only accept tightly packed rows
+    if (unpackAlignment > 0 && rowSize % unpackAlignment != 0)
+        return false;
+    if (rowSize * height != size)
+        return false;
+
+    const auto data = reinterpret_cast<const uchar *>(pixels);
+    const QImage image(data, width, height, rowSize,
+                       format == GL_RGBA ? QImage::Format_RGBA8888 : QImage::Format_RGB888);
+    const bool opaque = format == GL_RGB || isOpaque(data, size);
+    const bool lossy = currentPolicy == Policy::Lossy && allowLossy && opaque;
+    const QByteArray imageFormat = lossy ? lossyFormat() : QByteArrayLiteral("png");
+
+    QBuffer buffer(&result->data);
+    buffer.open(QIODevice::WriteOnly);
+    QImageWriter writer(&buffer, imageFormat);
+    if (lossy)
+        writer.setQuality(quality());
+    const bool ok = writer.write(lossy && format == GL_RGBA
+                                 ? image.convertToFormat(QImage::Format_RGB888) : image);
+    if (!ok) {
+        qCWarning(lc, "Failed to encode %dx%d texture as %s: %s", width, height,
+                  imageFormat.constData(), qPrintable(writer.errorString()));
+        result->data.clear();
+        return false;
+    }
+    if (result->data.size() >= size) {
+        result->data.clear();
+        return false;
+    }
+    result->mimeType = QByteArrayLiteral("image/") + imageFormat;
+    qCDebug(lc, "Encoded %dx%d texture as %s: %d -> %d bytes", width, height,
+            imageFormat.constData(), size, result->data.size());
+    return true;
+}
+
+}
+
+QT_END_NAMESPACE
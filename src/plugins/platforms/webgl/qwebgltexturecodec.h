@@ -0,0 +1,68 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QWEBGLTEXTURECODEC_H
+#define QWEBGLTEXTURECODEC_H
+
+#include <QtCore/qbytearray.h>
+#include <QtCore/qmetatype.h>
+#include <QtGui/qopengl.h>
+
+QT_BEGIN_NAMESPACE
+
+namespace QWebGLTextureCodec
+{
+
+enum class Policy {
+    None,       // Send raw pixels
+    Lossless,   // PNG (filtered + deflate)
+    Lossy       // WebP or JPEG for opaque full uploads, PNG for everything else
+};
+
+struct EncodedImage
+{
+    QByteArray mimeType;
+    QByteArray data;
+};
+
+Policy policy();
+int quality();
+
+// Returns true and fills 'result' if the upload was encoded. 'allowLossy' must be false for
+// partial uploads and for textures that are known to be atlases.
+bool encode(GLenum format, GLenum type, GLsizei width, GLsizei height, int unpackAlignment,
+            const char *pixels, int size, bool allowLossy, EncodedImage *result);
+
+}
+
+QT_END_NAMESPACE
+
+Q_DECLARE_METATYPE(QWebGLTextureCodec::EncodedImage)
+
+#endif // QWEBGLTEXTURECODEC_H
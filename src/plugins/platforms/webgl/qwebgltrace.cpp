@@ -0,0 +1,194 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#include "qwebgltrace.h"
+
+#include <QtCore/qatomic.h>
+#include <QtCore/qcoreapplication.h>
+#include <QtCore/qelapsedtimer.h>
+#include <QtCore/qloggingcategory.h>
+#include <QtCore/qmutex.h>
+#include <QtCore/qsavefile.h>
+#include <QtCore/qthread.h>
+
+#include <memory>
+#include <vector>
+
+QT_BEGIN_NAMESPACE
+
+static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.trace")
+
+namespace {
+
+struct Event
+{
+    const char *name;
+    qint64 begin;
+    qint64 end;
+};
+
+// Written by a single thread. The events are read while being overwritten, the reader drops
+// the ones whose slot was reused in the meantime, see QWebGLTrace::write.
+struct Track
+{
+    Track(const QString &name, int id) : name(name), id(id) {}
+
+    void record(const char *name, qint64 begin, qint64 end)
+    {
+        const auto index = count.loadRelaxed();
+        events[index % QWebGLTrace::capacity] = { name, begin, end };
+        count.storeRelease(index + 1);
+    }
+
+    const QString name;
+    const int id;
+    QAtomicInteger<quint32> count; // of the events recorded since the track was created
+    Event events[QWebGLTrace::capacity];
+};
+
+struct Registry
+{
+    Registry() { timer.start(); }
+
+    Track *addTrack(const QString &name)
+    {
+        QMutexLocker locker(&mutex);
+        tracks.emplace_back(new Track(name, int(tracks.size()) + 1));
+        return tracks.back().get();
+    }
+
+    QElapsedTimer timer;
+    QMutex mutex;
+    std::vector<std::unique_ptr<Track>> tracks;
+};
+
+thread_local Track *currentTrack = nullptr;
+
+}
+
+Q_GLOBAL_STATIC(Registry, registry)
+
+bool QWebGLTrace::isEnabled()
+{
+    static const bool enabled = !qgetenv("QT_WEBGL_TRACE").isEmpty();
+    return enabled;
+}
+
+qint64 QWebGLTrace::now()
+{
+    return registry()->timer.nsecsElapsed();
+}
+
+void QWebGLTrace::record(const char *name, qint64 begin, qint64 end)
+{
+    if (Q_UNLIKELY(!currentTrack)) {
+        const auto thread = QThread::currentThread();
+        const auto application = QCoreApplication::instance();
+        auto threadName = thread->objectName();
+        if (threadName.isEmpty() && application && thread == application->thread())
+            threadName = QStringLiteral("Main");
+        currentTrack = registry()->addTrack(threadName);
+    }
+    currentTrack->record(name, begin, end);
+}
+
+void QWebGLTrace::recordBrowser(const char *name, qint64 begin, qint64 end)
+{
+    static Track *const track = registry()->addTrack(QStringLiteral("Browser"));
+    track->record(name, begin, end);
+}
+
+static QByteArray escaped(const QString &string)
+{
+    QByteArray result = string.toUtf8();
+    result.replace('\\', "\\\\");
+    result.replace('"', "\\\"");
+    return result;
+}
+
+bool QWebGLTrace::write(const QString &fileName)
+{
+    if (!isEnabled())
+        return false;
+    std::vector<Track *> tracks;
+    {
+        QMutexLocker locker(&registry()->mutex);
+        for (const auto &track : registry()->tracks)
+            tracks.push_back(track.get());
+    }
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(lc, "Cannot write the trace to %s: %s", qPrintable(fileName),
+                  qPrintable(file.errorString()));
+        return false;
+    }
+    const auto pid = QByteArray::number(QCoreApplication::applicationPid());
+    file.write("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    bool first = true;
+    std::vector<Event> events;
+    for (const auto track : tracks) {
+        const auto tid = QByteArray::number(track->id);
+        const auto name = track->name.isEmpty() ? QStringLiteral("Thread %1").arg(track->id)
+                                                : track->name;
+        QByteArray json;
+        json += first ? "" : ",\n";
+        first = false;
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" + pid + ",\"tid\":" + tid
+                + ",\"args\":{\"name\":\"" + escaped(name) + "\"}}";
+
+        const quint32 count = track->count.loadAcquire();
+        const quint32 size = qMin(count, quint32(capacity));
+        events.clear();
+        for (quint32 i = count - size; i != count; ++i)
+            events.push_back(track->events[i % capacity]);
+        // The slots reused by the events recorded during the copy, and the one being written
+        const auto after = track->count.loadAcquire();
+        const auto dropped = qBound(qint64(0), qint64(after) + 1 + size - count - capacity,
+                                    qint64(size));
+        for (auto it = events.cbegin() + dropped; it != events.cend(); ++it) {
+            json += ",\n{\"name\":\"" + QByteArray(it->name) + "\",\"cat\":\"webgl\","
+                    "\"ph\":\"X\",\"pid\":" + pid + ",\"tid\":" + tid
+                    + ",\"ts\":" + QByteArray::number(it->begin / 1000., 'f', 3)
+                    + ",\"dur\":" + QByteArray::number((it->end - it->begin) / 1000., 'f', 3)
+                    + '}';
+        }
+        file.write(json);
+    }
+    file.write("\n]}\n");
+    if (!file.commit()) {
+        qCWarning(lc, "Cannot write the trace to %s: %s", qPrintable(fileName),
+                  qPrintable(file.errorString()));
+        return false;
+    }
+    qCDebug(lc, "Trace of %d threads written to %s", int(tracks.size()), qPrintable(fileName));
+    return true;
+}
+
+QT_END_NAMESPACE
@@ -0,0 +1,80 @@
+/****************************************************************************
+**
+** Copyright (C) 2022 The Qt Company Ltd.
+** Contact: https://www.qt.io/licensing/
+**
+** This file is part of the Qt WebGL module of the Qt Toolkit.
+**
+** $QT_BEGIN_LICENSE:GPL$
+** Commercial License Usage
+** Licensees holding valid commercial Qt licenses may use this file in
+** accordance with the commercial license agreement provided with the
+** Software or, alternatively, in accordance with the terms contained in
+** a written agreement between you and The Qt Company. For licensing terms
+** and conditions see https://www.qt.io/terms-conditions. For further
+** information use the contact form at https://www.qt.io/contact-us.
+**
+** GNU General Public License Usage
+** Alternatively, this file may be used under the terms of the GNU
+** General Public License version 3 or (at your option) any later version
+** approved by the KDE Free Qt Foundation. The licenses are as published by
+** the Free Software Foundation and appearing in the file LICENSE.GPL3
+** included in the packaging of this file. Please review the following
+** information to ensure the GNU General Public License requirements will
+** be met: https://www.gnu.org/licenses/gpl-3.0.html.
+**
+** $QT_END_LICENSE$
+**
+****************************************************************************/
+
+#ifndef QWEBGLTRACE_H
+#define QWEBGLTRACE_H
+
+#include <QtCore/qglobal.h>
+#include <QtCore/qstring.h>
+
+QT_BEGIN_NAMESPACE
+
+// Timeline of the plugin: each thread records its spans in a buffer of its own, without locking,
+// keeping the last 'capacity' spans. The browser execution spans reported by webqt.js go to a
+// "Browser" track. Enabled with QT_WEBGL_TRACE, which names the file written at exit; write()
+// saves the current timeline in the Chrome trace-event format read by chrome://tracing and the
+// Perfetto UI.
+class QWebGLTrace
+{
+public:
+    static const int capacity = 65536;
+
+    static bool isEnabled();
+    static qint64 now(); // nanoseconds
+
+    // 'name' must outlive the trace, a string literal in practice
+    static void record(const char *name, qint64 begin, qint64 end);
+    // Only called by the WebSocket thread
+    static void recordBrowser(const char *name, qint64 begin, qint64 end);
+
+    // Exposed through the native interface as "writeTrace"
+    static bool write(const QString &fileName);
+
+    class Span
+    {
+    public:
+        explicit Span(const char *name) :
+            name(isEnabled() ? name : nullptr), begin(this->name ? now() : 0)
+        {}
+        ~Span()
+        {
+            if (name)
+                record(name, begin, now());
+        }
+
+    private:
+        Q_DISABLE_COPY(Span)
+        const char *name;
+        qint64 begin;
+    };
+};
+
+QT_END_NAMESPACE
+
+#endif // QWEBGLTRACE_H
@@ -31,17 +31,27 @@
 
 #include "qwebglcontext.h"
 #include "qwebglfunctioncall.h"
+#include "qwebglgeometrycodec.h"
 #include "qwebglintegration.h"
 #include "qwebglintegration_p.h"
+#include "qwebgllatencytracer.h"
+#include "qwebglresourcetracker.h"
+#include "qwebgltexturecodec.h"
+#include "qwebgltrace.h"
 #include "qwebglwindow.h"
 #include "qwebglwindow_p.h"
 
 #include <QtCore/private/qobject_p.h>
 #include <QtCore/qcoreevent.h>
 #include <QtCore/qdebug.h>
+#include <QtCore/qendian.h>
+#include <QtCore/qhash.h>
 #include <QtCore/qjsonarray.h>
 #include <QtCore/qjsondocument.h>
 #include <QtCore/qjsonobject.h>
+#include <QtCore/qset.h>
+#include <QtCore/qsharedpointer.h>
+#include <QtCore/qthread.h>
 #include <QtCore/qwaitcondition.h>
 #include <QtGui/qevent.h>
 #include <QtGui/qguiapplication.h>
@@ -49,11 +59,14 @@
 #include <QtWebSockets/qwebsocket.h>
 #include <QtWebSockets/qwebsocketserver.h>
 
+#include <algorithm>
 #include <cstring>
+#include <vector>
 
 QT_BEGIN_NAMESPACE
 
 static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.websocketserver")
+static Q_LOGGING_CATEGORY(lcMessageBuffer, "qt.qpa.webgl.websocketserver.messagebuffer")
 
 inline QWebGLIntegration *webGLIntegration()
 {
@@ -66,13 +79,224 @@ inline QWebGLIntegration *webGLIntegration()
     return nativeInterface;
 }
 
+struct ShardedSocket
+{
+    int ioThread;
+    QSharedPointer<QAtomicInteger<qint64>> backlog; // bytesToWrite() after the last write
+};
+
 class QWebGLWebSocketServerPrivate
 {
 public:
+    // Runs the write in the thread owning the socket, see onNewConnection
+    template <typename Operation>
+    void write(QWebSocket *socket, Operation operation) const
+    {
+        const auto it = shardedSockets.constFind(socket);
+        if (it == shardedSockets.cend()) {
+            QWebGLTrace::Span span("write");
+            operation(socket);
+            return;
+        }
+        const auto backlog = it->backlog;
+        QMetaObject::invokeMethod(socket, [socket, operation, backlog]()
+        {
+            QWebGLTrace::Span span("write");
+            operation(socket);
+            backlog->storeRelaxed(socket->bytesToWrite());
+        }, Qt::QueuedConnection);
+    }
+
+    QByteArray encode(const QString &functionName, const QVariantList &parameters, int id);
+    void writeEncoded(const QVector<QWebSocket *> &sockets, const QByteArray &message);
+
+    qint64 backlog(QWebSocket *socket) const
+    {
+        const auto it = shardedSockets.constFind(socket);
+        return it == shardedSockets.cend() ? socket->bytesToWrite()
+                                           : it->backlog->loadRelaxed();
+    }
+
     QWebSocketServer *server = nullptr;
     quint16 initialPort = 0;
+    // Reused by every gl_command, see encode. Never shrunk, its size is only its high-water mark.
+    std::vector<char> messageBuffer;
+    QWebGLResourceTracker resourceTracker;
+    QSet<QWebSocket *> staleViewers; // skip frames until their backlog is written
+    QVector<QThread *> ioThreads;
+    QVector<int> ioThreadLoad; // sockets per I/O thread
+    QHash<QWebSocket *, ShardedSocket> shardedSockets;
+};
+
+// Larger message buffers are released after use instead of being kept for the next message
+static const qsizetype maxPooledMessageSize = 4 * 1024 * 1024;
+
+// A broadcast viewer with more pending data than this drops frames until it catches up
+static const qint64 maxViewerBacklog = 8 * 1024 * 1024;
+
+// The gl_command wire format: big endian integers, byte arrays prefixed by their 32 bit size
+struct MessageSizeCounter
+{
+    qsizetype size = 0;
+
+    template <typename T>
+    void write(T) { size += sizeof(T); }
+    void writeBytes(const QByteArray &bytes) { size += sizeof(quint32) + bytes.size(); }
+};
+
+struct MessageWriter
+{
+    char *cursor;
+
+    template <typename T>
+    void write(T value)
+    {
+        qToBigEndian(value, cursor);
+        cursor += sizeof(T);
+    }
+    void write(double value)
+    {
+        quint64 bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        write(bits);
+    }
+    void writeBytes(const QByteArray &bytes)
+    {
+        write(quint32(bytes.size()));
+        std::memcpy(cursor, bytes.constData(), bytes.size());
+        cursor += bytes.size();
+    }
 };
 
+template <typename Sink>
+static void serializeParameters(Sink &sink, const QVariantList &parameters)
+{
+    for (const auto &value : parameters) {
+        if (value.isNull()) {
+            sink.write(quint8('n'));
+        } else switch (value.type()) {
+        case QVariant::Int:
+            sink.write(quint8('i'));
+            sink.write(qint32(value.toInt()));
+            break;
+        case QVariant::UInt:
+            sink.write(quint8('u'));
+            sink.write(quint32(value.toUInt()));
+            break;
+        case QVariant::Bool:
+            sink.write(quint8('b'));
+            sink.write(quint8(value.toBool()));
+            break;
+        case QVariant::Double:
+            sink.write(quint8('d'));
+            sink.write(value.toDouble());
+            break;
+        case QVariant::String:
+            sink.write(quint8('s'));
+            sink.writeBytes(value.toString().toUtf8());
+            break;
+        case QVariant::ByteArray: {
+            // Shares the payload with the function call, the only copy is the one into the message
+            const auto byteArray = value.toByteArray();
+            if (byteArray.isNull()) {
+                sink.write(quint8('n'));
+            } else {
+                sink.write(quint8('x'));
+                sink.writeBytes(byteArray);
+            }
+            break;
+        }
+        case QVariant::List: {
+            const auto list = value.toList();
+            sink.write(quint8('a'));
+            sink.write(quint8(list.size()));
+            serializeParameters(sink, list);
+            break;
+        }
+        default:
+            if (value.userType() == qMetaTypeId<QWebGLTextureCodec::EncodedImage>()) {
+                const auto image = value.value<QWebGLTextureCodec::EncodedImage>();
+                sink.write(quint8('e'));
+                sink.writeBytes(image.mimeType);
+                sink.writeBytes(image.data);
+                break;
+            }
+            if (value.userType() == qMetaTypeId<QWebGLGeometryCodec::EncodedBuffer>()) {
+                const auto buffer = value.value<QWebGLGeometryCodec::EncodedBuffer>();
+                sink.write(quint8(buffer.kind));
+                sink.write(buffer.elementSize);
+                sink.write(buffer.count);
+                sink.writeBytes(buffer.data);
+                break;
+            }
+            qCCritical(lc, "Unsupported type: %d", value.type());
+            break;
+        }
+    }
+}
+
+// Writes the message at the start of data, grown to fit it if needed. Returns the message size.
+template <typename Buffer>
+static qsizetype encodeMessage(Buffer &data, const QString &functionName,
+                               const QVariantList &parameters, int id)
+{
+    // Measure first so the whole message, payloads included, is written with one copy into a
+    // buffer whose capacity may be kept between messages
+    QWebGLTrace::Span span("encode");
+    const quint8 functionIndex = QWebGLContext::functionIndex(functionName);
+    MessageSizeCounter counter;
+    counter.write(functionIndex);
+    if (id != -1)
+        counter.write(quint32(0));
+    serializeParameters(counter, parameters);
+    counter.write(quint32(0xbaadf00d));
+
+    if (qsizetype(data.size()) < counter.size)
+        data.resize(counter.size);
+    MessageWriter writer { data.data() };
+    writer.write(functionIndex);
+    if (id != -1)
+        writer.write(quint32(id));
+    serializeParameters(writer, parameters);
+    writer.write(quint32(0xbaadf00d));
+    Q_ASSERT(writer.cursor == data.data() + counter.size);
+    return counter.size;
+}
+
+// A view of the message buffer, valid until the next message is encoded
+QByteArray QWebGLWebSocketServerPrivate::encode(const QString &functionName,
+                                                const QVariantList &parameters, int id)
+{
+    const auto capacity = messageBuffer.capacity();
+    const auto size = encodeMessage(messageBuffer, functionName, parameters, id);
+    if (messageBuffer.capacity() != capacity) {
+        qCDebug(lcMessageBuffer, "Message buffer grown to %lld bytes",
+                qlonglong(messageBuffer.capacity()));
+    }
+    return QByteArray::fromRawData(messageBuffer.data(), int(size));
+}
+
+// QWebSocket copies the message into its write buffer, the view is written as is to the sockets
+// of this thread. The sockets of the I/O threads share a single copy.
+void QWebGLWebSocketServerPrivate::writeEncoded(const QVector<QWebSocket *> &sockets,
+                                                const QByteArray &message)
+{
+    QByteArray copy;
+    for (auto socket : sockets) {
+        if (!shardedSockets.contains(socket)) {
+            write(socket, [&message](QWebSocket *socket) { socket->sendBinaryMessage(message); });
+            continue;
+        }
+        if (copy.isNull())
+            copy = QByteArray(message.constData(), message.size());
+        write(socket, [copy](QWebSocket *socket) { socket->sendBinaryMessage(copy); });
+    }
+    if (qsizetype(messageBuffer.capacity()) > maxPooledMessageSize) {
+        std::vector<char>().swap(messageBuffer);
+        qCDebug(lcMessageBuffer, "Message buffer released");
+    }
+}
+
 QWebGLWebSocketServer::QWebGLWebSocketServer(quint16 port, QObject *parent) :
     QObject(parent),
     d_ptr(new QWebGLWebSocketServerPrivate)
@@ -81,7 +305,14 @@ QWebGLWebSocketServer::QWebGLWebSocketServer(quint16 port, QObject *parent) :
 }
 
 QWebGLWebSocketServer::~QWebGLWebSocketServer()
-{}
+{
+    Q_D(QWebGLWebSocketServer);
+    for (auto thread : qAsConst(d->ioThreads)) {
+        thread->quit();
+        thread->wait();
+        delete thread;
+    }
+}
 
 quint16 QWebGLWebSocketServer::port() const
 {
@@ -89,6 +320,30 @@ quint16 QWebGLWebSocketServer::port() const
     return d->server->serverPort();
 }
 
+int QWebGLWebSocketServer::ioThreadCount()
+{
+    static const int count = qMax(0, qEnvironmentVariableIntValue("QT_WEBGL_IO_THREADS"));
+    return count;
+}
+
+QByteArray QWebGLWebSocketServer::encodeGlCommand(const QWebGLFunctionCall &call)
+{
+    QByteArray data;
+    encodeMessage(data, call.functionName(), call.parameters(), call.id());
+    return data; // sized to the message by encodeMessage
+}
+
+bool QWebGLWebSocketServer::isSinglePort()
+{
+    static bool enabled = []() {
+        // A Unix domain socket listener is a single port
+        const auto value = qgetenv("QT_WEBGL_SINGLE_PORT");
+        return (!value.isEmpty() && value != "0")
+                || !qEnvironmentVariableIsEmpty("QT_WEBGL_LOCAL_SOCKET");
+    }();
+    return enabled;
+}
+
 QMutex *QWebGLWebSocketServer::mutex()
 {
     return &QWebGLIntegrationPrivate::instance()->waitMutex;
@@ -99,12 +354,26 @@ QWaitCondition *QWebGLWebSocketServer::waitCondition()
     return &QWebGLIntegrationPrivate::instance()->waitCondition;
 }
 
-QVariant QWebGLWebSocketServer::queryValue(int id)
+void QWebGLWebSocketServer::recordResponse(int id, const QVariant &value)
+{
+    Q_D(QWebGLWebSocketServer);
+    if (QWebGLResourceTracker::isEnabled())
+        d->resourceTracker.recordResponse(id, value);
+}
+
+void QWebGLWebSocketServer::cancelCreations()
 {
-    QMutexLocker locker(&QWebGLIntegrationPrivate::instance()->waitMutex);
-    if (QWebGLIntegrationPrivate::instance()->receivedResponses.contains(id))
-        return QWebGLIntegrationPrivate::instance()->receivedResponses.take(id);
-    return QVariant();
+    Q_D(QWebGLWebSocketServer);
+    if (QWebGLResourceTracker::isEnabled())
+        d->resourceTracker.cancelCreations();
+}
+
+void QWebGLWebSocketServer::replayResources(QWebSocket *socket)
+{
+    Q_D(QWebGLWebSocketServer);
+    d->resourceTracker.replay([=](MessageType type, const QVariantMap &values) {
+        sendMessage(socket, type, values);
+    });
 }
 
 void QWebGLWebSocketServer::create()
@@ -123,7 +392,17 @@ void QWebGLWebSocketServer::create()
 #endif
                                                                  QWebSocketServer::NonSecureMode);
     }
-    if (d->server->listen(hostAddress, url.port(d->initialPort))) {
+    for (int i = 0; i < ioThreadCount(); ++i) {
+        auto thread = new QThread;
+        thread->setObjectName(QStringLiteral("WebSocketIO%1").arg(i));
+        thread->start();
+        d->ioThreads.append(thread);
+        d->ioThreadLoad.append(0);
+    }
+    if (isSinglePort()) {
+        connect(d->server, &QWebSocketServer::newConnection,
+                this, &QWebGLWebSocketServer::onNewConnection);
+    } else if (d->server->listen(hostAddress, url.port(d->initialPort))) {
         connect(d->server, &QWebSocketServer::newConnection,
                 this, &QWebGLWebSocketServer::onNewConnection);
     } else {
@@ -135,6 +414,13 @@ void QWebGLWebSocketServer::create()
     QWebGLIntegrationPrivate::instance()->waitCondition.wakeAll();
 }
 
+void QWebGLWebSocketServer::handleConnection(QTcpSocket *socket)
+{
+    Q_D(QWebGLWebSocketServer);
+    // The handshake is still unread, the socket continues as if accepted by this server
+    d->server->handleConnection(socket);
+}
+
 void QWebGLWebSocketServer::sendMessage(QWebSocket *socket,
                                         MessageType type,
                                         const QVariantMap &values)
@@ -147,68 +433,9 @@ void QWebGLWebSocketServer::sendMessage(QWebSocket *socket,
         typeString = QStringLiteral("connect");
         qCDebug(lc) << "Sending connect to " << socket << values;
         break;
-    case MessageType::GlCommand: {
-        const auto functionName = values["function"].toString().toUtf8();
-        const auto parameters = values["parameters"].toList();
-        const quint32 parameterCount = parameters.size();
-        qCDebug(lc, "Sending gl_command %s to %p with %d parameters",
-                qPrintable(functionName), socket, parameterCount);
-        QByteArray data;
-        {
-            QDataStream stream(&data, QIODevice::WriteOnly);
-            stream << QWebGLContext::functionIndex(functionName);
-            if (values.contains("id")) {
-                auto ok = false;
-                stream << quint32(values["id"].toUInt(&ok));
-                Q_ASSERT(ok);
-            }
-            const std::function<void(const QVariantList &)> serialize = [&stream, &serialize](
-                    const QVariantList &parameters) {
-                for (const auto &value : parameters) {
-                    if (value.isNull()) {
-                        stream << (quint8)'n';
-                    } else switch (value.type()) {
-                    case QVariant::Int:
-                        stream << (quint8)'i' << value.toInt();
-                        break;
-                    case QVariant::UInt:
-                        stream << (quint8)'u' << value.toUInt();
-                        break;
-                    case QVariant::Bool:
-                        stream << (quint8)'b' << (quint8)value.toBool();
-                        break;
-                    case QVariant::Double:
-                        stream << (quint8)'d' << value.toDouble();
-                        break;
-                    case QVariant::String:
-                        stream << (quint8)'s' << value.toString().toUtf8();
-                        break;
-                    case QVariant::ByteArray: {
-                        const auto byteArray = value.toByteArray();
-                        if (byteArray.isNull())
-                            stream << (quint8)'n';
-                        else
-                            stream << (quint8)'x' << byteArray;
-                        break;
-                    }
-                    case QVariant::List: {
-                        const auto list = value.toList();
-                        stream << quint8('a') << quint8(list.size());
-                        serialize(list);
-                        break;
-                    }
-                    default:
-                        qCCritical(lc, "Unsupported type: %d", value.type());
-                        break;
-                    }
-                }
-            };
-            serialize(parameters);
-            stream << (quint32)0xbaadf00d;
-        }
-        socket->sendBinaryMessage(data);
+    case MessageType::GlCommand:
+        sendGlCommand({ socket }, values);
         return;
-    }
     case MessageType::CreateCanvas:
         qCDebug(lc) << "Sending create_canvas to " << socket << values;
         typeString = QStringLiteral("create_canvas");
@@ -226,13 +453,56 @@ void QWebGLWebSocketServer::sendMessage(QWebSocket *socket,
         qCDebug(lc) << "Sending change_title to " << socket << values;
         typeString = QStringLiteral("changle_title");
         break;
+    case MessageType::RestoreContext:
+        qCDebug(lc) << "Sending restore_context to " << socket << values;
+        typeString = QStringLiteral("restore_context");
+        break;
     }
     QJsonDocument document;
     auto commandObject = QJsonObject::fromVariantMap(values);
     commandObject["type"] = typeString;
     document.setObject(commandObject);
-    auto data = document.toJson(QJsonDocument::Compact);
-    socket->sendTextMessage(data);
+    const auto data = QString::fromUtf8(document.toJson(QJsonDocument::Compact));
+    Q_D(QWebGLWebSocketServer);
+    d->write(socket, [data](QWebSocket *socket) { socket->sendTextMessage(data); });
+}
+
+void QWebGLWebSocketServer::sendGlCommand(const QVector<QWebSocket *> &sockets,
+                                          const QVariantMap &values)
+{
+    Q_D(QWebGLWebSocketServer);
+    const auto functionName = values["function"].toString();
+    const auto parameters = values["parameters"].toList();
+    qCDebug(lc, "Sending gl_command %s to %d sockets with %d parameters",
+            qPrintable(functionName), sockets.size(), parameters.size());
+    d->writeEncoded(sockets, d->encode(functionName, parameters,
+                                       values.contains("id") ? values["id"].toInt() : -1));
+}
+
+void QWebGLWebSocketServer::sendBinaryMessage(const QVector<QWebSocket *> &sockets,
+                                              const QByteArray &message)
+{
+    Q_D(QWebGLWebSocketServer);
+    // The same buffer is written to every socket
+    for (auto socket : sockets)
+        d->write(socket, [message](QWebSocket *socket) { socket->sendBinaryMessage(message); });
+}
+
+void QWebGLWebSocketServer::updateViewers(const QVector<QWebSocket *> &viewers)
+{
+    Q_D(QWebGLWebSocketServer);
+    for (auto viewer : viewers) {
+        if (d->staleViewers.contains(viewer)) {
+            if (d->backlog(viewer) == 0) {
+                qCDebug(lc, "Viewer %p caught up, resynchronizing", viewer);
+                d->staleViewers.remove(viewer);
+                replayResources(viewer);
+            }
+        } else if (d->backlog(viewer) > maxViewerBacklog) {
+            qCDebug(lc, "Viewer %p is too slow, dropping frames", viewer);
+            d->staleViewers.insert(viewer);
+        }
+    }
 }
 
 bool QWebGLWebSocketServer::event(QEvent *event)
@@ -240,20 +510,33 @@ bool QWebGLWebSocketServer::event(QEvent *event)
     int type = event->type();
     if (type == QWebGLFunctionCall::type()) {
         auto e = static_cast<QWebGLFunctionCall *>(event);
-        QVariantMap values {
-           { "function", e->functionName() },
-           { "parameters", e->parameters() }
-        };
-        if (e->id() != -1)
-            values.insert("id", e->id());
+        Q_D(QWebGLWebSocketServer);
+        if (QWebGLResourceTracker::isEnabled())
+            d->resourceTracker.record(e->functionName(), e->parameters(), e->id());
         auto integrationPrivate = QWebGLIntegrationPrivate::instance();
         auto clientData = integrationPrivate->findClientData(e->surface());
         if (clientData && clientData->socket) {
-            sendMessage(clientData->socket, MessageType::GlCommand, values);
-            if (e->isBlocking())
-                integrationPrivate->pendingResponses.append(e->id());
+            // Viewers are only changed by this thread, see QWebGLIntegrationPrivate::addViewer
+            QVector<QWebSocket *> sockets { clientData->socket };
+            for (auto viewer : qAsConst(clientData->viewers)) {
+                if (!d->staleViewers.contains(viewer))
+                    sockets.append(viewer);
+            }
+            if (e->message().isNull()) {
+                qCDebug(lc, "Sending gl_command %s to %d sockets",
+                        qPrintable(e->functionName()), sockets.size());
+                d->writeEncoded(sockets, d->encode(e->functionName(), e->parameters(), e->id()));
+            } else {
+                sendBinaryMessage(sockets, e->message());
+            }
+            if (!clientData->viewers.isEmpty()
+                    && e->functionName() == QLatin1String("swapBuffers")) {
+                updateViewers(clientData->viewers);
+            }
             return true;
         }
+        if (e->isBlocking()) // nobody will answer, release the waiting thread
+            integrationPrivate->handleGlResponse(e->id(), QVariant());
         return false;
     }
     return QObject::event(event);
@@ -264,9 +547,23 @@ void QWebGLWebSocketServer::onNewConnection()
     Q_D(QWebGLWebSocketServer);
     QWebSocket *socket = d->server->nextPendingConnection();
     if (socket) {
+        if (!d->ioThreads.isEmpty()) {
+            // The least loaded I/O thread writes to the socket and reads its messages, which
+            // reach this thread through queued connections
+            const auto load = std::min_element(d->ioThreadLoad.begin(), d->ioThreadLoad.end());
+            const int ioThread = int(load - d->ioThreadLoad.begin());
+            ++*load;
+            socket->setParent(nullptr);
+            socket->moveToThread(d->ioThreads.at(ioThread));
+            d->shardedSockets.insert(socket, { ioThread,
+                                               QSharedPointer<QAtomicInteger<qint64>>::create(0) });
+            qCDebug(lc, "Socket %p served by I/O thread %d", socket, ioThread);
+        }
         connect(socket, &QWebSocket::disconnected, this, &QWebGLWebSocketServer::onDisconnect);
         connect(socket, &QWebSocket::textMessageReceived, this,
                 &QWebGLWebSocketServer::onTextMessageReceived);
+        connect(socket, &QWebSocket::binaryMessageReceived, this,
+                &QWebGLWebSocketServer::onBinaryMessageReceived);
 
         const QVariantMap values{
             {
@@ -279,6 +576,8 @@ void QWebGLWebSocketServer::onNewConnection()
             },
             { QStringLiteral("loadingScreen"), qgetenv("QT_WEBGL_LOADINGSCREEN") },
             { QStringLiteral("mouseTracking"), qgetenv("QT_WEBGL_MOUSETRACKING") },
+            { QStringLiteral("latencyTracing"), QWebGLLatencyTracer::isEnabled() },
+            { QStringLiteral("trace"), QWebGLTrace::isEnabled() },
             { QStringLiteral("supportedFunctions"),
               QVariant::fromValue(QWebGLContext::supportedFunctions()) },
             { "sysinfo",
@@ -302,8 +601,15 @@ void QWebGLWebSocketServer::onNewConnection()
 
 void QWebGLWebSocketServer::onDisconnect()
 {
+    Q_D(QWebGLWebSocketServer);
     QWebSocket *socket = qobject_cast<QWebSocket *>(sender());
     Q_ASSERT(socket);
+    d->staleViewers.remove(socket);
+    const auto it = d->shardedSockets.find(socket);
+    if (it != d->shardedSockets.end()) {
+        --d->ioThreadLoad[it->ioThread];
+        d->shardedSockets.erase(it);
+    }
     QWebGLIntegrationPrivate::instance()->clientDisconnected(socket);
     socket->deleteLater();
 }
@@ -314,4 +620,10 @@ void QWebGLWebSocketServer::onTextMessageReceived(const QString &message)
     QWebGLIntegrationPrivate::instance()->onTextMessageReceived(socket, message);
 }
 
+void QWebGLWebSocketServer::onBinaryMessageReceived(const QByteArray &message)
+{
+    const auto socket = qobject_cast<QWebSocket *>(sender());
+    QWebGLIntegrationPrivate::instance()->onBinaryMessageReceived(socket, message);
+}
+
 QT_END_NAMESPACE
@@ -32,12 +32,16 @@
 
 #include <QtCore/qobject.h>
 #include <QtCore/qscopedpointer.h>
+#include <QtCore/qvector.h>
 
 QT_BEGIN_NAMESPACE
 
 class QMutex;
+class QTcpSocket;
+class QVariant;
 class QWebSocket;
 class QWaitCondition;
+class QWebGLFunctionCall;
 class QWebGLWebSocketServerPrivate;
 
 class QWebGLWebSocketServer : public QObject
@@ -52,7 +56,8 @@ public:
         CreateCanvas,
         DestroyCanvas,
         OpenUrl,
-        ChangeTitle
+        ChangeTitle,
+        RestoreContext
     };
 
     QWebGLWebSocketServer(quint16 port, QObject *parent = nullptr);
@@ -60,10 +65,21 @@ public:
 
     quint16 port() const;
 
+    // Sockets are spread across this many threads, 0 keeps them on the server thread
+    static int ioThreadCount();
+    static QByteArray encodeGlCommand(const QWebGLFunctionCall &call);
+
+    // WebSocket connections arrive through the HTTP server port, see handleConnection
+    static bool isSinglePort();
+    void handleConnection(QTcpSocket *socket);
+
     QMutex *mutex();
     QWaitCondition *waitCondition();
 
-    QVariant queryValue(int id);
+    // Resource tracking for reconnecting clients, see QWebGLResourceTracker
+    void recordResponse(int id, const QVariant &value);
+    void cancelCreations();
+    void replayResources(QWebSocket *socket);
 
 public slots:
     void create();
@@ -78,8 +94,13 @@ private slots:
     void onNewConnection();
     void onDisconnect();
     void onTextMessageReceived(const QString &message);
+    void onBinaryMessageReceived(const QByteArray &message);
 
 private:
+    void sendGlCommand(const QVector<QWebSocket *> &sockets, const QVariantMap &values);
+    void sendBinaryMessage(const QVector<QWebSocket *> &sockets, const QByteArray &message);
+    void updateViewers(const QVector<QWebSocket *> &viewers);
+
     Q_DISABLE_COPY(QWebGLWebSocketServer)
     Q_DECLARE_PRIVATE(QWebGLWebSocketServer)
     QScopedPointer<QWebGLWebSocketServerPrivate> d_ptr;
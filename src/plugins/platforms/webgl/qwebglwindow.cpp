@@ -51,6 +51,7 @@ static Q_LOGGING_CATEGORY(lc, "qt.qpa.webgl.window")
 QAtomicInt QWebGLWindowPrivate::nextId(1);
 
 QWebGLWindowPrivate::QWebGLWindowPrivate(QWebGLWindow *p) :
+    defaultsFuture(defaults.get_future()),
     q_ptr(p)
 {}
 
@@ -159,7 +160,8 @@ void QWebGLWindow::setGeometry(const QRect &rect)
 void QWebGLWindow::setDefaults(const QMap<GLenum, QVariant> &values)
 {
     Q_D(QWebGLWindow);
-    d->defaults.set_value(values);
+    if (d->defaultsSet.testAndSetOrdered(0, 1))
+        d->defaults.set_value(values);
 }
 
 WId QWebGLWindow::winId() const
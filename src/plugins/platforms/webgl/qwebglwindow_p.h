@@ -62,6 +62,8 @@ public:
     Flags flags;
 
     std::promise<QMap<unsigned int, QVariant>> defaults;
+    std::shared_future<QMap<unsigned int, QVariant>> defaultsFuture;
+    QAtomicInt defaultsSet; // set from the connect or the default_context_parameters message
     int id = -1;
     static QAtomicInt nextId;
 
@@ -1,6 +1,7 @@
 TARGET = qwebgl
 QT += \
     websockets \
+    core-private \
     gui-private \
     eventdispatcher_support-private \
     fontdatabase_support-private \
@@ -12,24 +13,40 @@ qtHaveModule(quick) {
 
 HEADERS += \
     qwebglcontext.h \
+    qwebglframearena.h \
     qwebglfunctioncall.h \
+    qwebglgeometrycodec.h \
     qwebglhttpserver.h \
     qwebglintegration.h \
     qwebglintegration_p.h \
+    qwebgllatencytracer.h \
+    qwebglpixelconversion.h \
     qwebglplatformservices.h \
+    qwebglresourcetracker.h \
     qwebglscreen.h \
+    qwebglsessionmanager.h \
+    qwebgltexturecodec.h \
+    qwebgltrace.h \
     qwebglwebsocketserver.h \
     qwebglwindow.h \
     qwebglwindow_p.h
 
 SOURCES += \
     qwebglcontext.cpp \
+    qwebglframearena.cpp \
     qwebglfunctioncall.cpp \
+    qwebglgeometrycodec.cpp \
     qwebglhttpserver.cpp \
     qwebglintegration.cpp \
+    qwebgllatencytracer.cpp \
     qwebglmain.cpp \
+    qwebglpixelconversion.cpp \
     qwebglplatformservices.cpp \
+    qwebglresourcetracker.cpp \
     qwebglscreen.cpp \
+    qwebglsessionmanager.cpp \
+    qwebgltexturecodec.cpp \
+    qwebgltrace.cpp \
     qwebglwebsocketserver.cpp \
     qwebglwindow.cpp
 
@@ -14,9 +14,47 @@ function getContext(canvas) {
     var settings = { preserveDrawingBuffer: true };
     gl = canvas.getContext("webgl", settings) ||
          canvas.getContext("experimental-webgl", settings);
+    if (gl) {
+        // The server sends float and half float textures only if the client reports them
+        gl.getExtension("OES_texture_float");
+        gl.getExtension("OES_texture_half_float");
+    }
     return gl;
 }
 
+function getTextureSupport(gl) {
+    return {
+        "float": !!(gl && gl.getExtension("OES_texture_float")),
+        "halfFloat": !!(gl && gl.getExtension("OES_texture_half_float"))
+    };
+}
+
+// The values the server caches for glGet* calls. They are the same for every canvas, except the
+// viewport which the server derives from the window geometry.
+function getDefaultContextParameters(gl) {
+    var parameters = {
+        "7939": "GL_OES_element_index_uint GL_OES_standard_derivatives " + // GL_EXTENSIONS
+                "GL_OES_depth_texture GL_OES_packed_depth_stencil" };
+    if (!gl)
+        return parameters;
+    [
+        gl.BLEND,
+        gl.DEPTH_TEST,
+        gl.MAX_TEXTURE_SIZE,
+        gl.MAX_VERTEX_ATTRIBS,
+        gl.RENDERER,
+        gl.SCISSOR_TEST,
+        gl.STENCIL_TEST,
+        gl.UNPACK_ALIGNMENT,
+        gl.VENDOR,
+        gl.VERSION,
+        gl.VIEWPORT
+    ].forEach(function (value) {
+        parameters[value] = gl.getParameter(value);
+    });
+    return parameters;
+}
+
 function physicalSizeRatio() {
     var div = document.createElement("div");
     div.style.width = "1mm";
@@ -36,6 +74,8 @@ window.onload = function () {
     var DEBUG = 0;
     var MOUSETRACKING = 0;
     var LOADINGSCREEN = 1;
+    var LATENCYTRACING = 0;
+    var TRACE = 0;
     var canvas;
     var socket = new WebSocket("ws://" + host + ":" + port);
     socket.binaryType = "arraybuffer";
@@ -53,6 +93,7 @@ window.onload = function () {
     var windowData = {};
     var currentZIndex = 1;
     var textDecoder;
+    var textEncoder;
     var initialLoadingCanvas;
     var supportsTouch = 'ontouchstart' in window || navigator.msMaxTouchPoints;
 
@@ -67,7 +108,137 @@ window.onload = function () {
             }
         };
     }
-    var supportedFunctions;
+
+    if (typeof TextEncoder !== 'undefined') {
+        textEncoder = new TextEncoder();
+    } else {
+        textEncoder = {
+            "encode": function (string)
+            {
+                var utf8 = unescape(encodeURIComponent(string));
+                var bytes = new Uint8Array(utf8.length);
+                for (var i = 0; i < utf8.length; ++i)
+                    bytes[i] = utf8.charCodeAt(i);
+                return bytes;
+            }
+        };
+    }
+
+    // Type of the binary messages sent to the server, stored in their first byte. The layouts of
+    // the input records are described next to BinaryMessageType in qwebglintegration_p.h.
+    var BinaryMessage = { "GlResponse": 1, "Mouse": 2, "Wheel": 3, "Touch": 4, "Key": 5,
+                          "InputTrace": 6, "FrameTrace": 7, "ExecutionTrace": 8 };
+    var TouchPhase = { "touchstart": 0, "touchmove": 1, "touchend": 2, "touchcancel": 3 };
+    var KeyPhase = { "keydown": 0, "keyup": 1, "keypress": 2 };
+
+    var createBinaryWriter = function () {
+        var buffer = new ArrayBuffer(256);
+        var view = new DataView(buffer);
+        var offset = 0;
+        var reserve = function (size) {
+            if (offset + size <= buffer.byteLength)
+                return;
+            var grown = new ArrayBuffer(Math.max(buffer.byteLength * 2, offset + size));
+            new Uint8Array(grown).set(new Uint8Array(buffer, 0, offset));
+            buffer = grown;
+            view = new DataView(buffer);
+        };
+        var writer = {
+            "uint8": function (value) {
+                reserve(1);
+                view.setUint8(offset, value);
+                offset += 1;
+            },
+            "int32": function (value) {
+                reserve(4);
+                view.setInt32(offset, value);
+                offset += 4;
+            },
+            "uint32": function (value) {
+                reserve(4);
+                view.setUint32(offset, value);
+                offset += 4;
+            },
+            "float32": function (value) {
+                reserve(4);
+                view.setFloat32(offset, value);
+                offset += 4;
+            },
+            "float64": function (value) {
+                reserve(8);
+                view.setFloat64(offset, value);
+                offset += 8;
+            },
+            "bytes": function (array) {
+                writer.uint32(array.byteLength);
+                reserve(array.byteLength);
+                new Uint8Array(buffer, offset, array.byteLength).set(array);
+                offset += array.byteLength;
+            },
+            "string": function (string) {
+                writer.bytes(textEncoder.encode(string));
+            },
+            "data": function () {
+                return new Uint8Array(buffer, 0, offset);
+            }
+        };
+        return writer;
+    };
+
+    // Same tags as the gl_command parameters, arrays and maps use 32 bit element counts
+    var writeValue = function (writer, value) {
+        var tag = function (character) { writer.uint8(character.charCodeAt(0)); };
+        if (value === null || value === undefined) {
+            tag('n');
+        } else if (typeof value === "boolean") {
+            tag('b');
+            writer.uint8(value ? 1 : 0);
+        } else if (typeof value === "number") {
+            if (Number.isInteger(value) && value >= -2147483648 && value <= 2147483647) {
+                tag('i');
+                writer.int32(value);
+            } else if (Number.isInteger(value) && value >= 0 && value <= 4294967295) {
+                tag('u');
+                writer.uint32(value);
+            } else {
+                tag('d');
+                writer.float64(value);
+            }
+        } else if (typeof value === "string") {
+            tag('s');
+            writer.string(value);
+        } else if (value instanceof Uint8Array || value instanceof Uint8ClampedArray) {
+            tag('x');
+            writer.bytes(value);
+        } else if (value instanceof ArrayBuffer) {
+            tag('x');
+            writer.bytes(new Uint8Array(value));
+        } else if (Array.isArray(value) || ArrayBuffer.isView(value)) {
+            tag('a');
+            writer.uint32(value.length);
+            for (var i = 0; i < value.length; ++i)
+                writeValue(writer, value[i]);
+        } else if (typeof value === "object") {
+            // for..in also sees the attributes of WebGL objects like WebGLShaderPrecisionFormat
+            var keys = [];
+            for (var key in value) {
+                if (typeof value[key] !== "function")
+                    keys.push(key);
+            }
+            tag('m');
+            writer.uint32(keys.length);
+            for (var j = 0; j < keys.length; ++j) {
+                writer.string(keys[j]);
+                writeValue(writer, value[keys[j]]);
+            }
+        } else {
+            tag('n');
+        }
+    };
+    // Encoded texture payloads are decoded asynchronously. While a decode is in flight, incoming
+    // binary messages are queued so that commands keep their original order.
+    var pendingDecodes = 0;
+    var deferredMessages = [];
 
     var sendObject = function (obj) { socket.send(JSON.stringify(obj)); };
 
@@ -76,12 +247,24 @@ window.onload = function () {
         var width = size.width;
         var height = size.height;
         var physicalSize = physicalSizeRatio();
+        var probe = document.createElement("canvas").getContext("webgl");
+        var textureSupport = getTextureSupport(probe);
 
         var object = { "type": "connect",
             "width": width, "height": height,
             "physicalWidth": width / physicalSize.width,
-            "physicalHeight": height / physicalSize.height
+            "physicalHeight": height / physicalSize.height,
+            "imageBitmap": typeof createImageBitmap === "function",
+            "decompressionStream": typeof DecompressionStream === "function",
+            "floatTextures": textureSupport.float,
+            "halfFloatTextures": textureSupport.halfFloat,
+            // Sent up front so that windows can render as soon as they are created
+            "defaultContextParameters": getDefaultContextParameters(probe)
         };
+        // Browsers cap the number of live contexts, free the probe's without waiting for the GC
+        var loseContext = probe && probe.getExtension("WEBGL_lose_context");
+        if (loseContext)
+            loseContext.loseContext();
         sendObject(object);
         initialLoadingCanvas = createLoadingCanvas('loadingCanvas', 0, 0, width, height);
     };
@@ -89,7 +272,49 @@ window.onload = function () {
     var sendResponse = function (id, value) {
         if (DEBUG)
             console.log("Response to " + id + " = " + value);
-        sendObject({ "type": "gl_response", "id": id, "value": value });
+        var writer = createBinaryWriter();
+        writer.uint8(BinaryMessage.GlResponse);
+        writer.uint32(id);
+        writeValue(writer, value);
+        socket.send(writer.data());
+    };
+
+    // With latency tracing, every input record is preceded by a sequence number. The server tags
+    // the first frame swapped after the input with it, and the time of the input is kept until
+    // that frame is executed.
+    var inputSequence = 0;
+    var inputTimes = {};
+    var sendInputTrace = function () {
+        if (!LATENCYTRACING)
+            return;
+        inputSequence += 1;
+        inputTimes[inputSequence] = performance.now();
+        delete inputTimes[inputSequence - 1024]; // never shown
+        var writer = createBinaryWriter();
+        writer.uint8(BinaryMessage.InputTrace);
+        writer.uint32(inputSequence);
+        socket.send(writer.data());
+    };
+
+    var sendFrameTrace = function (sequence, executeTime) {
+        var inputTime = inputTimes[sequence];
+        if (inputTime === undefined) // input of another browser, see broadcast
+            return;
+        delete inputTimes[sequence];
+        var writer = createBinaryWriter();
+        writer.uint8(BinaryMessage.FrameTrace);
+        writer.uint32(sequence);
+        writer.float64(executeTime);
+        writer.float64(performance.now() - inputTime);
+        socket.send(writer.data());
+    };
+
+    // Execution time of a frame, for the timeline written by the server (QT_WEBGL_TRACE)
+    var sendExecutionTrace = function (executeTime) {
+        var writer = createBinaryWriter();
+        writer.uint8(BinaryMessage.ExecutionTrace);
+        writer.float64(executeTime);
+        socket.send(writer.data());
     };
 
     var createLoadingCanvas = function(name, x, y, width, height) {
@@ -209,13 +434,17 @@ window.onload = function () {
 
         var qtButtons = 0;
         var sendMouseEvent = function (buttons, layerX, layerY, clientX, clientY, name) {
-            var object = { "type": "mouse",
-                "buttons": buttons,
-                "layerX": layerX, "layerY": layerY, "clientX": clientX, "clientY": clientY,
-                "time": new Date().getTime().toString(),
-                "name": name
-            };
-            sendObject(object);
+            sendInputTrace();
+            var writer = createBinaryWriter();
+            writer.uint8(BinaryMessage.Mouse);
+            writer.uint32(name);
+            writer.float64(new Date().getTime());
+            writer.uint8(buttons);
+            writer.float32(layerX);
+            writer.float32(layerY);
+            writer.float32(clientX);
+            writer.float32(clientY);
+            socket.send(writer.data());
         };
 
         var mapButton = function (b) {
@@ -262,14 +491,18 @@ window.onload = function () {
             else if (event.detail)
                 deltaY = event.detail * 40;
             if (deltaY) {
-                var object = { "type": "wheel",
-                    "layerX": event.layerX, "layerY": event.layerY,
-                    "clientX": event.clientX, "clientY": event.clientY,
-                    "deltaX": event.deltaX, "deltaY": deltaY, "deltaZ": event.deltaZ,
-                    "time": new Date().getTime(),
-                    "name": name
-                };
-                sendObject(object);
+                sendInputTrace();
+                var writer = createBinaryWriter();
+                writer.uint8(BinaryMessage.Wheel);
+                writer.uint32(name);
+                writer.float64(new Date().getTime());
+                writer.float32(event.layerX);
+                writer.float32(event.layerY);
+                writer.float32(event.clientX);
+                writer.float32(event.clientY);
+                writer.float32(event.deltaX || 0);
+                writer.float32(deltaY);
+                socket.send(writer.data());
             }
             if (event.preventDefault)
                 event.preventDefault();
@@ -282,50 +515,41 @@ window.onload = function () {
         canvas.addEventListener('DOMMouseScroll', handleMouseWheel, { passive: true });
 
         function handleTouch(event) {
-            var object = {
-                "type": "touch",
-                "name": name,
-                "time": new Date().getTime().toString(),
-                "event": event.type,
-                "changedTouches": [],
-                "stationaryTouches": [],
-            };
-            var addTouch = function(changedTouch, isChanged) {
-                var touch = {
-                    "clientX": changedTouch.clientX,
-                    "clientY": changedTouch.clientY,
-                    "force": changedTouch.force,
-                    "identifier": changedTouch.identifier,
-                    "pageX": changedTouch.pageX,
-                    "pageY": changedTouch.pageY,
-                    "radiusX": changedTouch.radiusX,
-                    "radiusY": changedTouch.radiusY,
-                    "screenX": changedTouch.screenX,
-                    "screenY": changedTouch.screenY,
-                    "normalPositionX": changedTouch.screenX / screen.width,
-                    "normalPositionY": changedTouch.screenY / screen.height,
-                };
-                if (isChanged)
-                    object.changedTouches.push(touch);
-                else
-                    object.stationaryTouches.push(touch);
-            };
-
-            for (var i = 0; i < event.changedTouches.length; ++i) {
-                var changedTouch = event.changedTouches[i];
-                addTouch(changedTouch, true);
-            }
+            var changedTouches = [];
+            var stationaryTouches = [];
+            for (var i = 0; i < event.changedTouches.length; ++i)
+                changedTouches.push(event.changedTouches[i]);
 
             for (var i = 0; i < event.targetTouches.length; ++i) {
                 var targetTouch = event.targetTouches[i];
-                if (object.changedTouches.findIndex(function(touch){
+                if (changedTouches.findIndex(function(touch){
                     return touch.identifier === targetTouch.identifier;
                 }) === -1) {
-                    addTouch(targetTouch, false);
+                    stationaryTouches.push(targetTouch);
                 }
             }
 
-            sendObject(object);
+            sendInputTrace();
+            var writer = createBinaryWriter();
+            writer.uint8(BinaryMessage.Touch);
+            writer.uint32(name);
+            writer.float64(new Date().getTime());
+            writer.uint8(TouchPhase[event.type]);
+            writer.uint8(changedTouches.length);
+            writer.uint8(stationaryTouches.length);
+            changedTouches.concat(stationaryTouches).forEach(function (touch) {
+                writer.int32(touch.identifier);
+                writer.float32(touch.clientX);
+                writer.float32(touch.clientY);
+                writer.float32(touch.pageX);
+                writer.float32(touch.pageY);
+                writer.float32(touch.radiusX || 0);
+                writer.float32(touch.radiusY || 0);
+                writer.float32(typeof touch.force === "number" ? touch.force : 1);
+                writer.float32(touch.screenX / screen.width);
+                writer.float32(touch.screenY / screen.height);
+            });
+            socket.send(writer.data());
 
             if (event.preventDefault && event.cancelable)
                 event.preventDefault();
@@ -351,26 +575,6 @@ window.onload = function () {
             "loadingCanvas": createLoadingCanvas(name, x, y, width, height)
         };
 
-        var defaultValuesObject = { "type": "default_context_parameters", "name": name,
-            "7939": "GL_OES_element_index_uint GL_OES_standard_derivatives " + // GL_EXTENSIONS
-                    "GL_OES_depth_texture GL_OES_packed_depth_stencil" };
-        [
-            gl.BLEND,
-            gl.DEPTH_TEST,
-            gl.MAX_TEXTURE_SIZE,
-            gl.MAX_VERTEX_ATTRIBS,
-            gl.RENDERER,
-            gl.SCISSOR_TEST,
-            gl.STENCIL_TEST,
-            gl.UNPACK_ALIGNMENT,
-            gl.VENDOR,
-            gl.VERSION,
-            gl.VIEWPORT
-        ].forEach(function (value) {
-            defaultValuesObject[value] = gl.getParameter(value);
-        });
-        sendObject(defaultValuesObject);
-
         gl._attachShader = gl.attachShader;
         gl.attachShader = function(program, shader) {
             var d = contextData[currentContext];
@@ -571,6 +775,38 @@ window.onload = function () {
         gl.getBooleanv = gl.getParameter;
         gl.getIntegerv = gl.getParameter;
 
+        var getActiveInfo = function (getter, program, index) {
+            var d = contextData[currentContext];
+            var info = getter.call(gl, d.programMap[program], index);
+            if (!info)
+                return {};
+            return { "rtype": info.type, "rsize": info.size, "rname": info.name };
+        };
+
+        gl._getActiveAttrib = gl.getActiveAttrib;
+        gl.getActiveAttrib = function(program, index, bufSize) {
+            return getActiveInfo(gl._getActiveAttrib, program, index);
+        };
+
+        gl._getActiveUniform = gl.getActiveUniform;
+        gl.getActiveUniform = function(program, index, bufSize) {
+            return getActiveInfo(gl._getActiveUniform, program, index);
+        };
+
+        gl._readPixels = gl.readPixels;
+        gl.readPixels = function(x, y, width, height, format, type) {
+            var components = format === gl.RGBA ? 4 : format === gl.RGB ? 3 : 1;
+            var pixels;
+            if (type === gl.UNSIGNED_BYTE)
+                pixels = new Uint8Array(width * height * components);
+            else if (type === gl.FLOAT)
+                pixels = new Float32Array(width * height * components);
+            else // packed 16 bit types
+                pixels = new Uint16Array(width * height);
+            gl._readPixels(x, y, width, height, format, type, pixels);
+            return new Uint8Array(pixels.buffer);
+        };
+
         gl.getProgramiv = function(program, pname) {
             var d = contextData[currentContext];
             if (pname === 0x8B84) // INFO_LOG_LENGTH
@@ -619,11 +855,11 @@ window.onload = function () {
             } else {
                 var d = contextData[currentContext];
                 var p = gl._getUniformLocation(d.programMap[program], name);
-                var location = -1;
-                if (p) {
-                    location = d.nextLocation++;
-                    d.uniformLocationMap[location] = p;
-                }
+                // Numbered even when missing, the server counts the calls (nextNames)
+                var location = d.nextLocation++;
+                if (!p)
+                    return -1;
+                d.uniformLocationMap[location] = p;
                 return location;
             }
         };
@@ -669,40 +905,43 @@ window.onload = function () {
             gl._renderbufferStorage(target, internalFormat, width, height);
         };
 
+        var texturePixels = function (functionName, type, data) {
+            if (data === null || data.byteLength === 0)
+                return null;
+            if (type === gl.UNSIGNED_BYTE)
+                return data;
+            // Typed arrays need an aligned offset, copy the pixels out of the message buffer
+            var buffer = data.buffer.slice(data.byteOffset, data.byteOffset + data.byteLength);
+            if (type === gl.UNSIGNED_SHORT_5_6_5 || type === gl.UNSIGNED_SHORT_4_4_4_4 ||
+                    type === gl.UNSIGNED_SHORT_5_5_5_1 || type === 0x8D61) // HALF_FLOAT_OES
+                return new Uint16Array(buffer);
+            if (type === gl.FLOAT)
+                return new Float32Array(buffer);
+            console.error("gl." + functionName + ": Unsupported type");
+            return null;
+        };
+
         gl._texImage2D = gl.texImage2D;
         gl.texImage2D = function(target, level, internalFormat, width, height, border, format, type,
                                  data) {
-            var dataSize = data ? data.byteLength : 0;
-            var pixels;
-            if (data === null || dataSize === 0)
-                pixels = null;
-            else if (type === gl.UNSIGNED_BYTE)
-                pixels = data;
-            else if (type === g.UNSIGNED_SHORT_5_6_5 || type === UNSIGNED_SHORT_4_4_4_4 ||
-                       type === UNSIGNED_SHORT_5_5_5_1)
-                pixels = new DataView(new Uint16Array(data));
-            else
-                console.error("gl.texImage2D: Unsupported type");
+            if (typeof ImageBitmap !== "undefined" && data instanceof ImageBitmap) {
+                gl._texImage2D(target, level, internalFormat, format, type, data);
+                data.close();
+                return;
+            }
             gl._texImage2D(target, level, internalFormat, width, height, border, format, type,
-                           pixels);
+                           texturePixels("texImage2D", type, data));
         };
 
         gl._texSubImage2D = gl.texSubImage2D;
         gl.texSubImage2D = function(target, level, xoffset, yoffset, width, height, format, type, data) {
-            var dataSize = data ? data.byteLength : 0;
-            var pixels;
-            if (data === null || dataSize === 0)
-                pixels = null;
-            if (type === gl.UNSIGNED_BYTE)
-                pixels = data;
-            else if (type === gl.UNSIGNED_SHORT_5_6_5 || type === gl.UNSIGNED_SHORT_4_4_4_4 ||
-                     type === gl.UNSIGNED_SHORT_5_5_5_1 || type === ext.HALF_FLOAT_OES)
-                pixels = new Uint16Array(pixels);
-            else if (type === gl.FLOAT)
-                pixels = new Float32Array(pixels);
-            else
-                console.error("gl.texSubImage2D: Unsupported type");
-            gl._texSubImage2D(target, level, xoffset, yoffset, width, height, format, type, pixels);
+            if (typeof ImageBitmap !== "undefined" && data instanceof ImageBitmap) {
+                gl._texSubImage2D(target, level, xoffset, yoffset, format, type, data);
+                data.close();
+                return;
+            }
+            gl._texSubImage2D(target, level, xoffset, yoffset, width, height, format, type,
+                              texturePixels("texSubImage2D", type, data));
         };
 
         gl._shaderSource = gl.shaderSource;
@@ -835,6 +1074,8 @@ window.onload = function () {
         "genFramebuffers": undefined,
         "genRenderbuffers": undefined,
         "genTextures": undefined,
+        "getActiveAttrib": undefined,
+        "getActiveUniform": undefined,
         "getAttachedShaders": undefined,
         "getAttribLocation": undefined,
         "getBooleanv": undefined,
@@ -857,7 +1098,8 @@ window.onload = function () {
         "getVertexAttribiv": undefined,
         "getShaderSource": undefined,
         "getShaderInfoLog": undefined,
-        "isRenderbuffer": undefined
+        "isRenderbuffer": undefined,
+        "readPixels": undefined
     };
 
     var ensureContextData = function (context) {
@@ -922,11 +1164,110 @@ window.onload = function () {
         }
     };
 
+    // Recreates the objects of a context with their original names when the server resumes a
+    // session (see QWebGLResourceTracker). Applies to the context made current just before.
+    var restoreContext = function (obj) {
+        ensureContextData(obj.context);
+        var d = contextData[obj.context];
+        if (obj.uniformLocations) {
+            execGL(obj.context); // links the replayed programs
+            obj.uniformLocations.forEach(function (location) {
+                d.uniformLocationMap[location[0]] =
+                    gl._getUniformLocation(d.programMap[location[1]], location[2]);
+                d.nextLocation = Math.max(d.nextLocation, location[0] + 1);
+            });
+            return;
+        }
+        var restore = function (names, map, nextName, create) {
+            names.forEach(function (name) {
+                map[name] = create();
+                d[nextName] = Math.max(d[nextName], name + 1);
+            });
+        };
+        restore(obj.buffers, d.bufferMap, "nextBufferId",
+                function () { return gl.createBuffer(); });
+        restore(obj.textures, d.textureMap, "nextTextureId",
+                function () { return gl.createTexture(); });
+        restore(obj.framebuffers, d.framebufferMap, "nextFramebufferId",
+                function () { return gl.createFramebuffer(); });
+        restore(obj.renderbuffers, d.renderbufferMap, "nextRenderBufferId",
+                function () { return gl.createRenderbuffer(); });
+        restore(obj.programs, d.programMap, "nextProgramId",
+                function () { return gl._createProgram(); });
+        obj.shaders.forEach(function (shader) {
+            d.shaderMap[shader[0]] = { "shader": gl._createShader(shader[1]), "source": "" };
+            d.nextShaderId = Math.max(d.nextShaderId, shader[0] + 1);
+        });
+        // Names deleted since their creation were allocated as well, continue where the first
+        // client is
+        for (var nextName in obj.nextNames)
+            d[nextName] = Math.max(d[nextName], obj.nextNames[nextName]);
+    };
+
     var injectGL = function (context, funcName, parameters) {
         contextData[context].glCommands.push({ "function": funcName, "parameters": parameters });
     };
 
+    var decodeAsync = function (container, index, promise) {
+        ++pendingDecodes;
+        promise.then(function (value) {
+            container[index] = value;
+        }, function (error) {
+            console.error("Failed to decode payload: " + error);
+        }).then(function () {
+            --pendingDecodes;
+            while (!pendingDecodes && deferredMessages.length)
+                handleBinaryMessage(deferredMessages.shift());
+        });
+    };
+
+    var decodeIndices = function (bytes, indexSize, count) {
+        var indices = indexSize === 2 ? new Uint16Array(count) : new Uint32Array(count);
+        var previous = 0;
+        var position = 0;
+        for (var i = 0; i < count; ++i) {
+            // LEB128 varint of the zigzag encoded delta, decoded arithmetically so that deltas
+            // of 32 bit indices do not overflow
+            var value = 0;
+            var scale = 1;
+            var byte;
+            do {
+                byte = bytes[position++];
+                value += (byte & 0x7f) * scale;
+                scale *= 128;
+            } while (byte & 0x80);
+            previous += (value % 2) ? -(value + 1) / 2 : value / 2;
+            indices[i] = previous;
+        }
+        return new Uint8Array(indices.buffer);
+    };
+
+    var decodeVertices = function (compressed, elementSize, size) {
+        var stream = new Blob([ compressed ]).stream()
+                .pipeThrough(new DecompressionStream("deflate"));
+        return new Response(stream).arrayBuffer().then(function (buffer) {
+            var shuffled = new Uint8Array(buffer);
+            var data = new Uint8Array(size);
+            var count = Math.floor(size / elementSize);
+            for (var plane = 0; plane < elementSize; ++plane) {
+                var base = plane * count;
+                for (var i = 0; i < count; ++i)
+                    data[i * elementSize + plane] = shuffled[base + i];
+            }
+            data.set(shuffled.subarray(count * elementSize, size), count * elementSize);
+            return data;
+        });
+    };
+
     var handleBinaryMessage = function (event) {
+        if (pendingDecodes) {
+            deferredMessages.push(event);
+            return;
+        }
+        if (event.restore) { // a restore_context message queued behind pending decodes
+            restoreContext(event.restore);
+            return;
+        }
         var view = new DataView(event.data);
         var offset = 0;
         var obj = { "parameters": [] };
@@ -939,7 +1280,7 @@ window.onload = function () {
         if (obj.function === "makeCurrent")
             obj.parameterCount = 4;
         else if (obj.function === "swapBuffers")
-            obj.parameterCount = 0;
+            obj.parameterCount = null; // the sequence number of a traced input, if any
         else if (obj.function == "drawArrays")
             obj.parameterCount = null; // glDrawArrays has a variable number of arguments
         else
@@ -977,6 +1318,41 @@ window.onload = function () {
                         console.error("invalid data");
                     container.push(data);
                     offset += dataSize;
+                } else if (parameterType === 'e') {
+                    var mimeTypeSize = view.getUint32(offset);
+                    offset += 4;
+                    var mimeType = textDecoder.decode(new Uint8Array(event.data, offset,
+                                                                     mimeTypeSize));
+                    offset += mimeTypeSize;
+                    var imageSize = view.getUint32(offset);
+                    offset += 4;
+                    var blob = new Blob([ new Uint8Array(event.data, offset, imageSize) ],
+                                        { "type": mimeType });
+                    offset += imageSize;
+                    decodeAsync(container, container.push(null) - 1,
+                                createImageBitmap(blob, { "premultiplyAlpha": "none",
+                                                          "colorSpaceConversion": "none" }));
+                } else if (parameterType === 'v') {
+                    var indexSize = view.getUint8(offset);
+                    offset += 1;
+                    var indexCount = view.getUint32(offset);
+                    offset += 4;
+                    var encodedSize = view.getUint32(offset);
+                    offset += 4;
+                    container.push(decodeIndices(new Uint8Array(event.data, offset, encodedSize),
+                                                 indexSize, indexCount));
+                    offset += encodedSize;
+                } else if (parameterType === 'z') {
+                    var elementSize = view.getUint8(offset);
+                    offset += 1;
+                    var decodedSize = view.getUint32(offset);
+                    offset += 4;
+                    var compressedSize = view.getUint32(offset);
+                    offset += 4;
+                    decodeAsync(container, container.push(null) - 1,
+                                decodeVertices(new Uint8Array(event.data, offset, compressedSize),
+                                               elementSize, decodedSize));
+                    offset += compressedSize;
                 } else if (parameterType === 'n') {
                     container.push(null);
                 } else if (parameterType === 'a') {
@@ -1033,7 +1409,12 @@ window.onload = function () {
 
             if (DEBUG)
                 var t0 = performance.now();
+            var traceStart = LATENCYTRACING || TRACE ? performance.now() : 0;
             execGL(currentContext);
+            if (obj.parameters.length)
+                sendFrameTrace(obj.parameters[0], performance.now() - traceStart);
+            if (TRACE)
+                sendExecutionTrace(performance.now() - traceStart);
             if (startTime) {
                 console.log((new Date() - startTime) + "ms to first frame.");
                 startTime = undefined;
@@ -1122,6 +1503,11 @@ window.onload = function () {
             var canvas = document.getElementById(obj.winId);
             var body = document.getElementsByTagName("body")[0];
             body.removeChild(canvas);
+        } else if (obj.type === "restore_context") {
+            if (pendingDecodes)
+                deferredMessages.push({ "restore": obj });
+            else
+                restoreContext(obj);
         } else if (obj.type === "clipboard_updated") {
             // Opens a new window/tab and shows the current remote clipboard. There is no way to
             // copy some text to the local clipboard without user interaction.
@@ -1131,7 +1517,9 @@ window.onload = function () {
         } else if (obj.type === "change_title") {
             document.title = obj.text;
         } else if (obj.type === "connect") {
-            supportedFunctions = obj.supportedFunctions;
+            // The function table is also part of the served script (see QWebGLHttpServer)
+            if (obj.supportedFunctions)
+                supportedFunctions = obj.supportedFunctions;
             var sysinfo = obj.sysinfo;
             if (obj.debug)
                 DEBUG = 1;
@@ -1139,6 +1527,10 @@ window.onload = function () {
                 MOUSETRACKING = 1;
             if (obj.loadingScreen === "0")
                 LOADINGSCREEN = 0;
+            if (obj.latencyTracing)
+                LATENCYTRACING = 1;
+            if (obj.trace)
+                TRACE = 1;
             console.log(sysinfo);
         } else {
             console.error("Unknown message type");
@@ -1147,21 +1539,18 @@ window.onload = function () {
 
     var setupInput = function () {
         var keyHandler = function (event) {
-            var object = { "type": event.type,
-                "char": event.char,
-                "key": event.key,
-                "which": event.which,
-                "location": event.location,
-                "repeat": event.repeat,
-                "locale": event.locale,
-                "ctrlKey": event.ctrlKey, "shiftKey": event.shiftKey, "altKey": event.altKey,
-                "metaKey": event.metaKey,
-                "string": String.fromCharCode(event.which ||
-                                               event.keyCode),
-                "keyCode": event.keyCode, "charCode": event.charCode, "code": event.code,
-                "time": new Date().getTime(),
-            };
-            sendObject(object);
+            /* jslint bitwise: true */
+            sendInputTrace();
+            var writer = createBinaryWriter();
+            writer.uint8(BinaryMessage.Key);
+            writer.uint8(KeyPhase[event.type]);
+            writer.float64(new Date().getTime());
+            writer.uint8((event.ctrlKey ? 1 : 0) | (event.shiftKey ? 2 : 0) |
+                         (event.altKey ? 4 : 0) | (event.metaKey ? 8 : 0));
+            writer.uint32(event.which || 0);
+            writer.string(event.key || "");
+            writer.string(event.code || "");
+            socket.send(writer.data());
         }
 
         document.addEventListener('keypress', keyHandler, true);
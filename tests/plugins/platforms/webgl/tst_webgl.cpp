@@ -31,15 +31,21 @@
 #include <QtTest/qsignalspy.h>
 
 #include <QtCore/qcoreapplication.h>
+#include <QtCore/qdatastream.h>
+#include <QtCore/qelapsedtimer.h>
 #include <QtCore/qlibraryinfo.h>
+#include <QtCore/qmetaobject.h>
 #include <QtCore/qjsonarray.h>
 #include <QtCore/qjsondocument.h>
 #include <QtCore/qjsonobject.h>
 #include <QtCore/qobject.h>
 #include <QtCore/qprocess.h>
 #include <QtCore/qregularexpression.h>
+#include <QtCore/qtimer.h>
+#include <QtGui/qcolor.h>
 #include <QtGui/qguiapplication.h>
 #include <QtGui/qopengl.h>
+#include <QtGui/qpa/qplatformnativeinterface.h>
 #include <QtNetwork/qnetworkaccessmanager.h>
 #include <QtNetwork/qnetworkreply.h>
 #include <QtNetwork/qtcpsocket.h>
@@ -47,11 +53,90 @@
 
 #include "parameters.h"
 
+#include <algorithm>
+#include <functional>
 #include <memory>
 
 #define PORT 29836
 #define PORTSTRING QT_STRINGIFY(PORT)
 
+// Produces a byte pattern much faster than a slow client can read it, run with -streamer
+class StreamProducer : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    static const int totalSize = 16 * 1024 * 1024;
+    static const int blockSize = 256 * 1024;
+
+    StreamProducer()
+    {
+        open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+        timer.setInterval(0);
+        connect(&timer, &QTimer::timeout, this, &StreamProducer::produce);
+    }
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override
+    {
+        return buffer.size() - offset + QIODevice::bytesAvailable();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        const auto size = qMin(maxSize, qint64(buffer.size() - offset));
+        memcpy(data, buffer.constData() + offset, size_t(size));
+        offset += int(size);
+        if (offset == buffer.size()) {
+            buffer.clear();
+            offset = 0;
+        }
+        return size;
+    }
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+    void connectNotify(const QMetaMethod &signal) override
+    {
+        // Starts when the server streams the device to a client
+        if (signal == QMetaMethod::fromSignal(&QIODevice::readyRead) && !produced)
+            timer.start();
+    }
+
+private:
+    void produce()
+    {
+        buffer.remove(0, offset);
+        offset = 0;
+        for (int i = 0; i < blockSize; ++i, ++produced)
+            buffer.append(char(produced % 251));
+        emit readyRead();
+        if (produced == totalSize) {
+            timer.stop();
+            emit readChannelFinished();
+        }
+    }
+
+    QTimer timer;
+    QByteArray buffer;
+    int offset = 0;
+    int produced = 0;
+};
+
+static int runStreamer(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+    using SetCustomRequestDevice = void (*)(const QString &, QIODevice *);
+    const auto setCustomRequestDevice = reinterpret_cast<SetCustomRequestDevice>(
+            app.platformNativeInterface()->nativeResourceFunctionForIntegration(
+                    "setcustomrequestdevice"));
+    if (!setCustomRequestDevice)
+        return 1;
+    StreamProducer producer;
+    setCustomRequestDevice(QStringLiteral("/stream"), &producer);
+    return app.exec();
+}
+
 class tst_WebGL : public QObject
 {
     Q_OBJECT
@@ -96,11 +181,25 @@ class tst_WebGL : public QObject
     QWebSocket webSocket;
     QStringList functions;
     QProcess process;
+    QByteArrayList processOutput;
     qintptr websocketPort;
+    bool binaryResponses = false;
+    bool binaryInput = false;
+    QMultiHash<QString, QJsonValue> responses; // values sent back, by function
 
     void connectToQmlScene();
     void sendMouseEvent(Qt::MouseButtons buttons, quint32 x, quint32 y, int winId);
     void sendMouseClick(quint32 x, quint32 y, int winId);
+    void sendWheelEvent(quint32 x, quint32 y, float deltaX, float deltaY, int winId);
+    void sendResponse(int id, const QJsonValue &value);
+
+    struct HttpResponse
+    {
+        int status = 0;
+        QHash<QByteArray, QByteArray> headers; // by lower case name
+        QByteArray body;
+    };
+    QVector<HttpResponse> readHttpResponses(QTcpSocket &socket, int count);
 
     template <typename Struct>
     Struct *pointer(const QVariant &id, QHash<int, Struct> &container)
@@ -133,11 +232,44 @@ private slots:
     void waitForSwapBuffers_data();
     void waitForSwapBuffers();
 
+    void binaryResponses_data();
+    void binaryResponses();
+
     void reload_data();
     void reload();
 
     void update_data();
     void update();
+
+    void messageBufferReuse_data();
+    void messageBufferReuse();
+
+    void inputOrder_data();
+    void inputOrder();
+
+    void wheelBothAxes_data();
+    void wheelBothAxes();
+
+    void httpSplitHead_data();
+    void httpSplitHead();
+
+    void httpLargeHead_data();
+    void httpLargeHead();
+
+    void httpOversizedHead_data();
+    void httpOversizedHead();
+
+    void httpPipelining_data();
+    void httpPipelining();
+
+    void httpNotModified_data();
+    void httpNotModified();
+
+    void httpEmptyBody_data();
+    void httpEmptyBody();
+
+    void streamSlowReader_data();
+    void streamSlowReader();
 };
 
 void tst_WebGL::connectToQmlScene()
@@ -161,6 +293,18 @@ void tst_WebGL::connectToQmlScene()
 
 void tst_WebGL::sendMouseEvent(Qt::MouseButtons buttons, quint32 x, quint32 y, const int winId)
 {
+    if (binaryInput) {
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << quint8(2) << quint32(winId) // mouse
+               << double(QDateTime::currentDateTime().toMSecsSinceEpoch())
+               << quint8(buttons);
+        stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+        stream << float(x) << float(y) << float(x) << float(y);
+        webSocket.sendBinaryMessage(data);
+        return;
+    }
+
     const QJsonDocument message {
         QJsonObject {
             { QLatin1String("type"), QLatin1String("mouse") },
@@ -182,6 +326,35 @@ void tst_WebGL::sendMouseClick(quint32 x, quint32 y, int winId)
     sendMouseEvent(Qt::NoButton, x, y, winId);
 }
 
+void tst_WebGL::sendWheelEvent(quint32 x, quint32 y, float deltaX, float deltaY, int winId)
+{
+    if (binaryInput) {
+        QByteArray data;
+        QDataStream stream(&data, QIODevice::WriteOnly);
+        stream << quint8(3) << quint32(winId) // wheel
+               << double(QDateTime::currentDateTime().toMSecsSinceEpoch());
+        stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+        stream << float(x) << float(y) << float(x) << float(y) << deltaX << deltaY;
+        webSocket.sendBinaryMessage(data);
+        return;
+    }
+
+    const QJsonDocument message {
+        QJsonObject {
+            { QLatin1String("type"), QLatin1String("wheel") },
+            { QLatin1String("layerX"), int(x) },
+            { QLatin1String("layerY"), int(y) },
+            { QLatin1String("clientX"), int(x) },
+            { QLatin1String("clientY"), int(y) },
+            { QLatin1String("deltaX"), int(deltaX) },
+            { QLatin1String("deltaY"), int(deltaY) },
+            { QLatin1String("time"), QDateTime::currentDateTime().toMSecsSinceEpoch() },
+            { QLatin1String("name"), winId }
+        }
+    };
+    webSocket.sendTextMessage(message.toJson());
+}
+
 bool tst_WebGL::findSwapBuffers(const QSignalSpy &spy)
 {
     return std::find_if(spy.cbegin(), spy.cend(), [](const QList<QVariant> &list) {
@@ -239,6 +412,8 @@ void tst_WebGL::parseBinaryMessage(const QByteArray &data)
         QLatin1String("genFramebuffers"),
         QLatin1String("genRenderbuffers"),
         QLatin1String("genTextures"),
+        QLatin1String("getActiveAttrib"),
+        QLatin1String("getActiveUniform"),
         QLatin1String("getAttachedShaders"),
         QLatin1String("getAttribLocation"),
         QLatin1String("getBooleanv"),
@@ -378,21 +553,104 @@ void tst_WebGL::parseBinaryMessage(const QByteArray &data)
         } else {
             QFAIL("Function not handled");
         }
+        responses.insert(function, retval);
+        sendResponse(id, retval);
+    }
+}
+
+void tst_WebGL::sendResponse(int id, const QJsonValue &value)
+{
+    if (!binaryResponses) {
         const QJsonDocument answer {
             QJsonObject {
                 { QLatin1String("type"), QLatin1String("gl_response") },
                 { QLatin1String("id"), id },
-                { QLatin1String("value"), retval }
+                { QLatin1String("value"), value }
             }
         };
         webSocket.sendTextMessage(answer.toJson());
+        return;
+    }
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    const std::function<void(const QJsonValue &)> serialize = [&](const QJsonValue &value) {
+        switch (value.type()) {
+        case QJsonValue::Bool:
+            stream << quint8('b') << quint8(value.toBool());
+            break;
+        case QJsonValue::Double:
+            if (value.toDouble() == value.toInt())
+                stream << quint8('i') << qint32(value.toInt());
+            else
+                stream << quint8('d') << value.toDouble();
+            break;
+        case QJsonValue::String:
+            stream << quint8('s') << value.toString().toUtf8();
+            break;
+        case QJsonValue::Array: {
+            const auto array = value.toArray();
+            stream << quint8('a') << quint32(array.size());
+            for (const auto &element : array)
+                serialize(element);
+            break;
+        }
+        default:
+            stream << quint8('n');
+            break;
+        }
+    };
+    stream << quint8(1) << quint32(id); // gl_response
+    serialize(value);
+    webSocket.sendBinaryMessage(data);
+}
+
+QVector<tst_WebGL::HttpResponse> tst_WebGL::readHttpResponses(QTcpSocket &socket, int count)
+{
+    QVector<HttpResponse> answers;
+    QByteArray buffer;
+    QElapsedTimer timer;
+    timer.start();
+    while (answers.size() < count && timer.elapsed() < 5000) {
+        const int headEnd = buffer.indexOf("\r\n\r\n");
+        if (headEnd != -1) {
+            HttpResponse response;
+            const auto lines = buffer.left(headEnd).split('\n');
+            response.status = lines.first().split(' ').value(1).toInt();
+            for (const auto &line : lines.mid(1)) {
+                const int colon = line.indexOf(':');
+                response.headers.insert(line.left(colon).trimmed().toLower(),
+                                        line.mid(colon + 1).trimmed());
+            }
+            const int bodyEnd = headEnd + 4 + response.headers.value("content-length").toInt();
+            if (buffer.size() >= bodyEnd) {
+                response.body = buffer.mid(headEnd + 4, bodyEnd - headEnd - 4);
+                buffer.remove(0, bodyEnd);
+                answers.append(response);
+                continue;
+            }
+        }
+        socket.waitForReadyRead(100);
+        const auto data = socket.readAll();
+        if (data.isEmpty() && socket.state() != QAbstractSocket::ConnectedState)
+            break;
+        buffer += data;
     }
+    return answers;
 }
 
 void tst_WebGL::initTestCase()
 {
     connect(&webSocket, &QWebSocket::binaryMessageReceived, this, &tst_WebGL::parseBinaryMessage);
     connect(&webSocket, &QWebSocket::textMessageReceived, this, &tst_WebGL::parseTextMessage);
+    connect(&process, &QProcess::readyReadStandardOutput, this, [this]() {
+        while (process.canReadLine()) {
+            processOutput.append(process.readLine());
+#if defined(QT_DEBUG)
+            qDebug() << process.pid() << processOutput.last();
+#endif // defined(QT_DEBUG)
+        }
+    });
 }
 
 void tst_WebGL::init()
@@ -405,6 +663,10 @@ void tst_WebGL::init()
     shaders.clear();
     textures.clear();
     currentContext = nullptr;
+    binaryResponses = false;
+    binaryInput = false;
+    responses.clear();
+    processOutput.clear();
 
     const auto tryToConnect = [=](quint16 port = PORT) {
         QTcpSocket socket;
@@ -422,20 +684,21 @@ void tst_WebGL::init()
 #endif
 
     process.setProcessChannelMode(QProcess::MergedChannels);
-    process.setProgram(QLibraryInfo::location(QLibraryInfo::BinariesPath) + QChar('/')
-                       + executableName);
-    process.setArguments(QStringList { QDir::toNativeSeparators(scene) });
+    if (scene.isEmpty()) { // No scene, this executable serves a stream
+        process.setProgram(QCoreApplication::applicationFilePath());
+        process.setArguments(QStringList { QStringLiteral("-streamer") });
+    } else {
+        process.setProgram(QLibraryInfo::location(QLibraryInfo::BinariesPath) + QChar('/')
+                           + executableName);
+        process.setArguments(QStringList { QDir::toNativeSeparators(scene) });
+    }
     process.setEnvironment(QProcess::systemEnvironment()
-                           << "QT_QPA_PLATFORM=webgl:port=" PORTSTRING);
+                           << "QT_QPA_PLATFORM=webgl:port=" PORTSTRING
+                           << "QT_LOGGING_RULES="
+                              "qt.qpa.webgl.websocketserver.messagebuffer.debug=true");
     process.start();
     process.waitForStarted();
     QVERIFY(process.isOpen());
-#if defined(QT_DEBUG)
-    connect(&process, &QProcess::readyReadStandardOutput, [=]() {
-        while (process.bytesAvailable())
-            qDebug() << process.pid() << process.readLine();
-    });
-#endif // defined(QT_DEBUG)
     QTRY_VERIFY(tryToConnect());
 
     auto reply = manager.get(QNetworkRequest(QUrl("http://localhost:" PORTSTRING "/webqt.js")));
@@ -486,6 +749,57 @@ void tst_WebGL::waitForSwapBuffers()
     QTRY_VERIFY(findSwapBuffers(spy));
 }
 
+void tst_WebGL::binaryResponses_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::newRow("Basic scene") << QFINDTESTDATA("basic_scene.qml");
+}
+
+void tst_WebGL::binaryResponses()
+{
+    {
+        QSignalSpy spy(this, &tst_WebGL::queryCommand);
+        QTRY_VERIFY(findSwapBuffers(spy));
+        QVERIFY(!QTest::currentTestFailed());
+    }
+
+    // A new session, so that all the queries of the scene are answered in binary
+    binaryResponses = true;
+    responses.clear();
+    webSocket.close();
+    connectToQmlScene();
+    QSignalSpy queries(this, &tst_WebGL::queryCommand);
+    QSignalSpy commands(this, &tst_WebGL::command);
+    QTRY_VERIFY(findSwapBuffers(queries));
+    QVERIFY(!QTest::currentTestFailed());
+    binaryResponses = false;
+
+    // The application got the values we answered: it uses the programs and the uniform
+    // locations returned to it
+    const auto programs = responses.values(QStringLiteral("createProgram"));
+    const auto locations = responses.values(QStringLiteral("getUniformLocation"));
+    QVERIFY(!programs.isEmpty());
+    QVERIFY(!locations.isEmpty());
+    int usedPrograms = 0;
+    int usedLocations = 0;
+    for (const auto &arguments : commands) {
+        const auto function = arguments.at(0).toString();
+        const auto parameters = arguments.at(1).toList();
+        if (parameters.isEmpty())
+            continue;
+        const QJsonValue value(parameters.first().toInt());
+        if (function == QStringLiteral("useProgram") && parameters.first().toInt() != 0) {
+            QVERIFY2(programs.contains(value), qPrintable(parameters.first().toString()));
+            ++usedPrograms;
+        } else if (function.startsWith(QStringLiteral("uniform"))) {
+            QVERIFY2(locations.contains(value), qPrintable(parameters.first().toString()));
+            ++usedLocations;
+        }
+    }
+    QVERIFY(usedPrograms > 0);
+    QVERIFY(usedLocations > 0);
+}
+
 void tst_WebGL::reload_data()
 {
     QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
@@ -508,12 +822,17 @@ void tst_WebGL::reload()
 void tst_WebGL::update_data()
 {
     QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
-    QTest::newRow("Colors") << QFINDTESTDATA("colors.qml");
-    QTest::newRow("Launcher") << QFINDTESTDATA("launcher.qml");
+    QTest::addColumn<bool>("binaryInput");
+    QTest::newRow("Colors") << QFINDTESTDATA("colors.qml") << false;
+    QTest::newRow("Colors (binary input)") << QFINDTESTDATA("colors.qml") << true;
+    QTest::newRow("Launcher") << QFINDTESTDATA("launcher.qml") << false;
+    QTest::newRow("Launcher (binary input)") << QFINDTESTDATA("launcher.qml") << true;
 }
 
 void tst_WebGL::update()
 {
+    QFETCH(bool, binaryInput);
+    this->binaryInput = binaryInput;
     {
         QSignalSpy spy(this, &tst_WebGL::queryCommand);
         QTRY_VERIFY_WITH_TIMEOUT(findSwapBuffers(spy), 10000);
@@ -526,6 +845,304 @@ void tst_WebGL::update()
     }
 }
 
-QTEST_MAIN(tst_WebGL)
+void tst_WebGL::messageBufferReuse_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::newRow("Colors") << QFINDTESTDATA("colors.qml");
+}
+
+void tst_WebGL::messageBufferReuse()
+{
+    // The gl_commands are encoded into a buffer kept between messages. Once a session sent the
+    // scene, sending it again to a new session must not grow the buffer anymore.
+    const auto growths = [this]() {
+        return std::count_if(processOutput.cbegin(), processOutput.cend(),
+                             [](const QByteArray &line) {
+            return line.contains("Message buffer grown");
+        });
+    };
+    {
+        QSignalSpy spy(this, &tst_WebGL::queryCommand);
+        QTRY_VERIFY_WITH_TIMEOUT(findSwapBuffers(spy), 10000);
+        QVERIFY(!QTest::currentTestFailed());
+    }
+    QTest::qWait(500); // the output of the process is read asynchronously
+    const auto firstSession = growths();
+    QVERIFY(firstSession > 0);
+
+    webSocket.close();
+    connectToQmlScene();
+    {
+        QSignalSpy spy(this, &tst_WebGL::queryCommand);
+        QTRY_VERIFY_WITH_TIMEOUT(findSwapBuffers(spy), 10000);
+        QVERIFY(!QTest::currentTestFailed());
+    }
+    QTest::qWait(500);
+    QCOMPARE(growths(), firstSession);
+}
+
+void tst_WebGL::inputOrder_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::addColumn<bool>("binaryInput");
+    QTest::newRow("Input order") << QFINDTESTDATA("input_order.qml") << false;
+    QTest::newRow("Input order (binary input)") << QFINDTESTDATA("input_order.qml") << true;
+}
+
+void tst_WebGL::inputOrder()
+{
+    QFETCH(bool, binaryInput);
+    this->binaryInput = binaryInput;
+    {
+        QSignalSpy spy(this, &tst_WebGL::queryCommand);
+        QTRY_VERIFY_WITH_TIMEOUT(findSwapBuffers(spy), 10000);
+        QVERIFY(!QTest::currentTestFailed());
+    }
+
+    // The moves are coalesced. Delivered after the press, the last one would carry no button
+    // and release the mouse area again, which turns the window back to blue.
+    QSignalSpy commands(this, &tst_WebGL::command);
+    const auto clearColor = [&commands]() {
+        for (auto it = commands.crbegin(); it != commands.crend(); ++it) {
+            const auto parameters = it->at(1).toList();
+            if (it->at(0).toString() == QLatin1String("clearColor") && parameters.size() == 4) {
+                return QColor::fromRgbF(parameters.at(0).toDouble(), parameters.at(1).toDouble(),
+                                        parameters.at(2).toDouble(), parameters.at(3).toDouble());
+            }
+        }
+        return QColor();
+    };
+    for (quint32 x = 10; x < 100; x += 5)
+        sendMouseEvent(Qt::NoButton, x, 10, currentContext->winId);
+    sendMouseEvent(Qt::LeftButton, 100, 10, currentContext->winId);
+    QTRY_COMPARE(clearColor(), QColor(Qt::red));
+    QTest::qWait(500);
+    QCOMPARE(clearColor(), QColor(Qt::red));
+}
+
+void tst_WebGL::wheelBothAxes_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::addColumn<bool>("binaryInput");
+    QTest::newRow("Wheel") << QFINDTESTDATA("wheel.qml") << false;
+    QTest::newRow("Wheel (binary input)") << QFINDTESTDATA("wheel.qml") << true;
+}
+
+void tst_WebGL::wheelBothAxes()
+{
+    QFETCH(bool, binaryInput);
+    this->binaryInput = binaryInput;
+    {
+        QSignalSpy spy(this, &tst_WebGL::queryCommand);
+        QTRY_VERIFY_WITH_TIMEOUT(findSwapBuffers(spy), 10000);
+        QVERIFY(!QTest::currentTestFailed());
+    }
+
+    QSignalSpy commands(this, &tst_WebGL::command);
+    const auto clearColor = [&commands]() {
+        for (auto it = commands.crbegin(); it != commands.crend(); ++it) {
+            const auto parameters = it->at(1).toList();
+            if (it->at(0).toString() == QLatin1String("clearColor") && parameters.size() == 4) {
+                return QColor::fromRgbF(parameters.at(0).toDouble(), parameters.at(1).toDouble(),
+                                        parameters.at(2).toDouble(), parameters.at(3).toDouble());
+            }
+        }
+        return QColor();
+    };
+    // A diagonal scroll, the window turns red if the horizontal part is lost
+    sendWheelEvent(100, 100, 30, 40, currentContext->winId);
+    QTRY_VERIFY(clearColor().isValid() && clearColor() != QColor(Qt::blue));
+    QCOMPARE(clearColor(), QColor(Qt::green));
+}
+
+void tst_WebGL::httpSplitHead_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::newRow("Basic scene") << QFINDTESTDATA("basic_scene.qml");
+}
+
+void tst_WebGL::httpSplitHead()
+{
+    QTcpSocket socket;
+    socket.connectToHost("localhost", PORT);
+    QVERIFY(socket.waitForConnected());
+    socket.write("GET /webqt.js HTTP/1.1\r\nHo");
+    QVERIFY(socket.waitForBytesWritten());
+    QTest::qWait(100);
+    socket.write("st: localhost\r\n");
+    QVERIFY(socket.waitForBytesWritten());
+    QTest::qWait(100);
+    socket.write("\r\n");
+    const auto answers = readHttpResponses(socket, 1);
+    QCOMPARE(answers.size(), 1);
+    QCOMPARE(answers.first().status, 200);
+    QVERIFY(answers.first().body.contains("var port = "));
+}
+
+void tst_WebGL::httpLargeHead_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::newRow("Basic scene") << QFINDTESTDATA("basic_scene.qml");
+}
+
+void tst_WebGL::httpLargeHead()
+{
+    // Bigger than the former limit of 2048 bytes, below the default one of 16 KiB
+    QTcpSocket socket;
+    socket.connectToHost("localhost", PORT);
+    QVERIFY(socket.waitForConnected());
+    socket.write("GET /webqt.js HTTP/1.1\r\nHost: localhost\r\nCookie: session="
+                 + QByteArray(8 * 1024, 'a') + "\r\n\r\n");
+    const auto answers = readHttpResponses(socket, 1);
+    QCOMPARE(answers.size(), 1);
+    QCOMPARE(answers.first().status, 200);
+    QVERIFY(answers.first().body.contains("var port = "));
+}
+
+void tst_WebGL::httpOversizedHead_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::newRow("Basic scene") << QFINDTESTDATA("basic_scene.qml");
+}
+
+void tst_WebGL::httpOversizedHead()
+{
+    QTcpSocket socket;
+    socket.connectToHost("localhost", PORT);
+    QVERIFY(socket.waitForConnected());
+    socket.write("GET /webqt.js HTTP/1.1\r\nHost: localhost\r\nCookie: session="
+                 + QByteArray(20 * 1024, 'a') + "\r\n\r\n");
+    const auto answers = readHttpResponses(socket, 1);
+    QCOMPARE(answers.size(), 1);
+    QCOMPARE(answers.first().status, 431);
+    QCOMPARE(answers.first().headers.value("connection"), QByteArray("close"));
+}
+
+void tst_WebGL::httpPipelining_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::newRow("Basic scene") << QFINDTESTDATA("basic_scene.qml");
+}
+
+void tst_WebGL::httpPipelining()
+{
+    QTcpSocket socket;
+    socket.connectToHost("localhost", PORT);
+    QVERIFY(socket.waitForConnected());
+    socket.write("GET /webqt.js HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                 "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    const auto answers = readHttpResponses(socket, 2);
+    QCOMPARE(answers.size(), 2);
+    QCOMPARE(answers.at(0).status, 200);
+    QVERIFY(answers.at(0).body.contains("var port = "));
+    QCOMPARE(answers.at(0).headers.value("connection"), QByteArray("keep-alive"));
+    QCOMPARE(answers.at(1).status, 200);
+    QVERIFY(answers.at(1).headers.value("content-type").startsWith("text/html"));
+}
+
+void tst_WebGL::httpNotModified_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::newRow("Basic scene") << QFINDTESTDATA("basic_scene.qml");
+}
+
+void tst_WebGL::httpNotModified()
+{
+    QTcpSocket socket;
+    socket.connectToHost("localhost", PORT);
+    QVERIFY(socket.waitForConnected());
+    socket.write("GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    auto answers = readHttpResponses(socket, 1);
+    QCOMPARE(answers.size(), 1);
+    QCOMPARE(answers.first().status, 200);
+    const auto etag = answers.first().headers.value("etag");
+    QVERIFY(!etag.isEmpty());
+
+    socket.write("GET / HTTP/1.1\r\nHost: localhost\r\nIf-None-Match: " + etag + "\r\n\r\n");
+    answers = readHttpResponses(socket, 1);
+    QCOMPARE(answers.size(), 1);
+    QCOMPARE(answers.first().status, 304);
+    QCOMPARE(answers.first().headers.value("etag"), etag);
+    QVERIFY(answers.first().body.isEmpty());
+}
+
+void tst_WebGL::httpEmptyBody_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::newRow("Basic scene") << QFINDTESTDATA("basic_scene.qml");
+}
+
+void tst_WebGL::httpEmptyBody()
+{
+    // Without a body to skip, the connection stays usable for the requests that follow
+    QTcpSocket socket;
+    socket.connectToHost("localhost", PORT);
+    QVERIFY(socket.waitForConnected());
+    socket.write("GET /webqt.js HTTP/1.1\r\nHost: localhost\r\nContent-Length: 0\r\n\r\n"
+                 "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    const auto answers = readHttpResponses(socket, 2);
+    QCOMPARE(answers.size(), 2);
+    QCOMPARE(answers.at(0).status, 200);
+    QCOMPARE(answers.at(0).headers.value("connection"), QByteArray("keep-alive"));
+    QCOMPARE(answers.at(1).status, 200);
+}
+
+void tst_WebGL::streamSlowReader_data()
+{
+    QTest::addColumn<QString>("scene"); // Fetched in tst_WebGL::init
+    QTest::newRow("Streamer") << QString();
+}
+
+void tst_WebGL::streamSlowReader()
+{
+    QTcpSocket socket;
+    socket.setReadBufferSize(4096);
+    socket.connectToHost("localhost", PORT);
+    QVERIFY(socket.waitForConnected());
+    socket.write("GET /stream HTTP/1.1\r\nHost: localhost\r\n\r\n");
+    // The whole stream is produced while the client does not read, most of it stays in the
+    // server waiting for the client
+    QTest::qWait(1000);
+
+    socket.setReadBufferSize(0);
+    QByteArray data;
+    QElapsedTimer timer;
+    timer.start();
+    while (!data.endsWith("\r\n0\r\n\r\n") && timer.elapsed() < 30000) {
+        if (!socket.bytesAvailable() && !socket.waitForReadyRead(1000))
+            continue;
+        data += socket.readAll();
+    }
+
+    const int headEnd = data.indexOf("\r\n\r\n");
+    QVERIFY(headEnd != -1);
+    QVERIFY(data.startsWith("HTTP/1.1 200 "));
+    QVERIFY(data.left(headEnd).toLower().contains("transfer-encoding: chunked"));
+    QByteArray body;
+    for (int position = headEnd + 4;;) {
+        const int sizeEnd = data.indexOf("\r\n", position);
+        QVERIFY(sizeEnd != -1);
+        bool ok = false;
+        const int size = data.mid(position, sizeEnd - position).toInt(&ok, 16);
+        QVERIFY(ok);
+        if (!size)
+            break;
+        body += data.mid(sizeEnd + 2, size);
+        position = sizeEnd + 2 + size + 2;
+    }
+    QCOMPARE(body.size(), int(StreamProducer::totalSize));
+    for (int i = 0; i < body.size(); ++i) {
+        if (body.at(i) != char(i % 251))
+            QFAIL(qPrintable(QString::fromLatin1("Unexpected byte at %1").arg(i)));
+    }
+    QTRY_COMPARE(socket.state(), QAbstractSocket::UnconnectedState);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && qstrcmp(argv[1], "-streamer") == 0)
+        return runStreamer(argc, argv);
+    QTEST_MAIN_IMPL(tst_WebGL)
+}
 
 #include "tst_webgl.moc"
@@ -1,6 +1,7 @@
 CONFIG += testcase
 
 QT += \
+    gui-private \
     testlib \
     quick \
     websockets
@@ -20,6 +21,8 @@ OTHER_FILES += \
     colors.qml \
     images/back.png \
     images/next.png \
+    input_order.qml \
     launcher.qml \
     LauncherList.qml \
-    SimpleLauncherDelegate.qml
+    SimpleLauncherDelegate.qml \
+    wheel.qml